@@ -317,6 +317,9 @@ struct ClassDeclaration : AggregateDeclaration
 
 #if IN_LLVM
     virtual void codegen(Ir*);
+
+    // true if a class in this compilation derives from this one
+    bool hasSubclasses;
 #endif
 };
 
@@ -856,6 +856,11 @@ struct FuncDeclaration : Declaration
 
     // true if overridden with the pragma(allow_inline); stmt
     bool allowInlining;
+
+    // number of functions overriding this one in the whole compilation and
+    // the first of them, used to devirtualize calls
+    unsigned overrideCount;
+    FuncDeclaration* firstOverride;
 #endif
 };
 
@@ -28,6 +28,9 @@
 #include "attrib.h" // for AttribDeclaration
 
 #include "template.h"
+#if IN_LLVM
+#include "driver/timetrace.h"
+#endif
 TemplateInstance *isSpeculativeFunction(FuncDeclaration *fd);
 
 
@@ -464,6 +467,11 @@ Expression *FuncDeclaration::interpret(InterState *istate, Expressions *argument
 {
 #if LOG
     printf("\n********\nFuncDeclaration::interpret(istate = %p) %s\n", istate, toChars());
+#endif
+#if IN_LLVM
+    // only record the outermost call of each CTFE evaluation
+    TimeTraceScope timeScope(istate ? NULL : "CTFE",
+        (timeTraceEnabled && !istate) ? toPrettyChars() : NULL);
 #endif
     if (semanticRun == PASSsemantic3)
         return EXP_CANT_INTERPRET;
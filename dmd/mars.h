@@ -309,6 +309,7 @@ struct Param
 
     // Codegen cl options
     bool singleObj;
+    bool dedupTemplates;
     bool disableRedZone;
     bool noVerify;
 #endif
@@ -31,6 +31,9 @@
 #include "declaration.h"
 #include "dsymbol.h"
 #include "hdrgen.h"
+#if IN_LLVM
+#include "driver/timetrace.h"
+#endif
 
 #if WINDOWS_SEH
 #include <windows.h>
@@ -3438,6 +3441,9 @@ Dsymbol *TemplateInstance::syntaxCopy(Dsymbol *s)
 
 void TemplateInstance::semantic(Scope *sc)
 {
+#if IN_LLVM
+    TimeTraceScope timeScope("Template", timeTraceEnabled ? toChars() : NULL);
+#endif
     if (global.errors)
     {
         if (!global.gag)
@@ -65,6 +65,9 @@ ClassDeclaration::ClassDeclaration(Loc loc, Identifier *id, BaseClasses *basecla
     vtblsym = NULL;
 #endif
     vclassinfo = NULL;
+#if IN_LLVM
+    hasSubclasses = false;
+#endif
 
     if (id)
     {   // Look for special class names
@@ -492,6 +495,9 @@ void ClassDeclaration::semantic(Scope *sc)
     {
         if (baseClass->storage_class & STCfinal)
             error("cannot inherit from final class %s", baseClass->toChars());
+#if IN_LLVM
+        baseClass->hasSubclasses = true;
+#endif
 
         interfaces_dim--;
         interfaces++;
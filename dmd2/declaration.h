@@ -891,6 +891,11 @@ struct FuncDeclaration : Declaration
     
     // true if has inline assembler
     bool inlineAsm;
+
+    // number of functions overriding this one in the whole compilation and
+    // the first of them, used to devirtualize calls
+    unsigned overrideCount;
+    FuncDeclaration* firstOverride;
 #endif
 };
 
@@ -99,6 +99,8 @@ FuncDeclaration::FuncDeclaration(Loc loc, Loc endloc, Identifier *id, StorageCla
     isArrayOp = false;
     allowInlining = false;
     availableExternally = true; // assume this unless proven otherwise
+    overrideCount = 0;
+    firstOverride = NULL;
 
     // function types in ldc don't merge if the context parameter differs
     // so we actually don't care about the function declaration, but only
@@ -560,6 +562,11 @@ void FuncDeclaration::semantic(Scope *sc)
                 /* Remember which functions this overrides
                  */
                 foverrides.push(fdv);
+#if IN_LLVM
+                if (!fdv->firstOverride)
+                    fdv->firstOverride = this;
+                fdv->overrideCount++;
+#endif
 
                 /* This works by whenever this function is called,
                  * it actually returns tintro, which gets dynamically
@@ -85,9 +85,15 @@ int Identifier::dyncast()
 
 Identifier *Identifier::generateId(const char *prefix)
 {
+#if IN_LLVM
+    if (Preparse::current)
+        return Preparse::current->placeholder(&Preparse::current->generatedIds, prefix);
+    return generateId(prefix, ++Preparse::generatedIdNum);
+#else
     static size_t i;
 
     return generateId(prefix, ++i);
+#endif
 }
 
 Identifier *Identifier::generateId(const char *prefix, size_t i)
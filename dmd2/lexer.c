@@ -25,6 +25,9 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <time.h>       // for time() and ctime()
+#if IN_LLVM && POSIX
+#include <pthread.h>
+#endif
 
 #include "rmem.h"
 
@@ -102,7 +105,11 @@ void Token::print()
 
 const char *Token::toChars()
 {   const char *p;
+#if IN_LLVM
+    static THREAD_LOCAL char buffer[3 + 3 * sizeof(float80value) + 1];
+#else
     static char buffer[3 + 3 * sizeof(float80value) + 1];
+#endif
 
     p = buffer;
     switch (value)
@@ -223,7 +230,11 @@ const char *Token::toChars()
 
 const char *Token::toChars(enum TOK value)
 {   const char *p;
+#if IN_LLVM
+    static THREAD_LOCAL char buffer[3 + 3 * sizeof(value) + 1];
+#else
     static char buffer[3 + 3 * sizeof(value) + 1];
+#endif
 
     p = tochars[value];
     if (!p)
@@ -235,9 +246,44 @@ const char *Token::toChars(enum TOK value)
 
 /*************************** Lexer ********************************************/
 
+#if IN_LLVM
+THREAD_LOCAL Token *Lexer::freelist = NULL;
+StringTable Lexer::stringtable;
+#else
 Token *Lexer::freelist = NULL;
 StringTable Lexer::stringtable;
 OutBuffer Lexer::stringbuffer;
+#endif
+
+#if IN_LLVM
+#if POSIX
+static pthread_mutex_t stringtableLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/********************************************
+ * Look up the identifier s[0 .. len] in the string table, adding it if
+ * it is new. The threads preparsing modules share the table.
+ */
+
+static Identifier *poolIdentifier(const char *s, unsigned len)
+{
+#if POSIX
+    if (Preparse::current)
+        pthread_mutex_lock(&stringtableLock);
+#endif
+    StringValue *sv = Lexer::stringtable.update(s, len);
+    Identifier *id = (Identifier *) sv->ptrvalue;
+    if (!id)
+    {   id = new Identifier(sv->lstring.string, TOKidentifier);
+        sv->ptrvalue = id;
+    }
+#if POSIX
+    if (Preparse::current)
+        pthread_mutex_unlock(&stringtableLock);
+#endif
+    return id;
+}
+#endif
 
 Lexer::Lexer(Module *mod,
         unsigned char *base, unsigned begoffset, unsigned endoffset,
@@ -314,6 +360,10 @@ void Lexer::error(Loc loc, const char *format, ...)
 
 void Lexer::verror(Loc loc, const char *format, va_list ap)
 {
+#if IN_LLVM
+    if (Preparse::fail())
+        return;
+#endif
     if (mod && !global.gag)
     {
         char *p = loc.toChars();
@@ -662,12 +712,16 @@ void Lexer::scan(Token *t)
                     break;
                 }
 
+#if IN_LLVM
+                Identifier *id = poolIdentifier((char *)t->ptr, p - t->ptr);
+#else
                 StringValue *sv = stringtable.update((char *)t->ptr, p - t->ptr);
                 Identifier *id = (Identifier *) sv->ptrvalue;
                 if (!id)
                 {   id = new Identifier(sv->lstring.string,TOKidentifier);
                     sv->ptrvalue = id;
                 }
+#endif
                 t->ident = id;
                 t->value = (enum TOK) id->value;
                 anyToken = 1;
@@ -677,6 +731,16 @@ void Lexer::scan(Token *t)
                     static char time[8+1];
                     static char timestamp[24+1];
 
+#if IN_LLVM
+                    // ctime() is not thread-safe, leave the first use to the
+                    // main thread.
+                    if (Preparse::current)
+                    {
+                        if (!date[0] && (id == Id::DATE || id == Id::TIME || id == Id::TIMESTAMP))
+                            Preparse::fail();
+                    }
+                    else
+#endif
                     if (!date[0])       // lazy evaluation
                     {   time_t t;
                         char *p;
@@ -2873,6 +2937,9 @@ unsigned char *Lexer::combineComments(unsigned char *c1, unsigned char *c2)
 Identifier *Lexer::idPool(const char *s)
 {
     size_t len = strlen(s);
+#if IN_LLVM
+    return poolIdentifier(s, len);
+#else
     StringValue *sv = stringtable.update(s, len);
     Identifier *id = (Identifier *) sv->ptrvalue;
     if (!id)
@@ -2881,6 +2948,7 @@ Identifier *Lexer::idPool(const char *s)
         sv->ptrvalue = id;
     }
     return id;
+#endif
 }
 
 /*********************************************
@@ -2898,10 +2966,94 @@ Identifier *Lexer::uniqueId(const char *s, int num)
 
 Identifier *Lexer::uniqueId(const char *s)
 {
+#if IN_LLVM
+    if (Preparse::current)
+        return Preparse::current->placeholder(&Preparse::current->uniqueIds, s);
+    return uniqueId(s, ++Preparse::uniqueIdNum);
+#else
     static int num;
     return uniqueId(s, ++num);
+#endif
+}
+
+#if IN_LLVM
+/****************************************
+ * Preparse
+ */
+
+THREAD_LOCAL Preparse *Preparse::current;
+int Preparse::uniqueIdNum;
+size_t Preparse::generatedIdNum;
+
+Preparse::Preparse()
+{
+    failed = 0;
+}
+
+/* Call instead of reporting a diagnostic. Returns !=0 if this thread is
+ * preparsing a module, which will then be parsed again serially.
+ */
+
+int Preparse::fail()
+{
+    if (!current)
+        return 0;
+    current->failed = 1;
+    return 1;
 }
 
+/* Make an identifier outside of the string table, which commit() turns
+ * into the one prefix with the next number would have given.
+ */
+
+Identifier *Preparse::placeholder(Array *ids, const char *prefix)
+{
+    Identifier *id = new Identifier(prefix, TOKidentifier);
+    ids->push(id);
+    return id;
+}
+
+static int namePlaceholders(Array *ids, size_t num, int insert)
+{
+    for (size_t i = 0; i < ids->dim; i++)
+    {   Identifier *id = (Identifier *)ids->data[i];
+        OutBuffer buf;
+
+        buf.printf("%s%zu", id->string, num + i + 1);
+        if (!insert)
+        {   // The serial parse would share an identifier that exists already.
+            if (Lexer::stringtable.lookup((char *)buf.data, buf.offset))
+                return 0;
+            continue;
+        }
+        StringValue *sv = Lexer::stringtable.insert((char *)buf.data, buf.offset);
+        assert(sv);
+        id->string = sv->lstring.string;
+        id->len = buf.offset;
+        sv->ptrvalue = id;
+    }
+    return 1;
+}
+
+/* On the main thread, in module order: number the placeholders as the
+ * serial parse would have. Returns 0 if that's not possible, the module
+ * then has to be parsed again.
+ */
+
+int Preparse::commit()
+{
+    if (failed ||
+        !namePlaceholders(&uniqueIds, uniqueIdNum, 0) ||
+        !namePlaceholders(&generatedIds, generatedIdNum, 0))
+        return 0;
+    namePlaceholders(&uniqueIds, uniqueIdNum, 1);
+    namePlaceholders(&generatedIds, generatedIdNum, 1);
+    uniqueIdNum += uniqueIds.dim;
+    generatedIdNum += generatedIds.dim;
+    return 1;
+}
+#endif
+
 /****************************************
  */
 
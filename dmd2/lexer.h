@@ -22,6 +22,14 @@ struct StringTable;
 struct Identifier;
 struct Module;
 
+#if IN_LLVM
+#if _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+#endif
+
 /* Tokens:
         (       )
         [       ]
@@ -265,8 +273,14 @@ struct Token
 struct Lexer
 {
     static StringTable stringtable;
+#if IN_LLVM
+    // Root modules may be lexed on several threads, see Module::preparse().
+    OutBuffer stringbuffer;
+    static THREAD_LOCAL Token *freelist;
+#else
     static OutBuffer stringbuffer;
     static Token *freelist;
+#endif
 
     Loc loc;                    // for error messages
 
@@ -318,4 +332,28 @@ struct Lexer
     static unsigned char *combineComments(unsigned char *c1, unsigned char *c2);
 };
 
+#if IN_LLVM
+/* State of a thread parsing a module ahead of the main thread (see
+ * Module::preparse()). Diagnostics and the numbers of generated
+ * identifiers depend on the order in which the modules are parsed, so
+ * the thread neither reports the former nor assigns the latter.
+ */
+struct Preparse
+{
+    static THREAD_LOCAL Preparse *current;  // of this thread, NULL on the main thread
+
+    static int uniqueIdNum;             // last number used by Lexer::uniqueId()
+    static size_t generatedIdNum;       // last number used by Identifier::generateId()
+
+    int failed;                 // a diagnostic was suppressed, parse serially
+    Array uniqueIds;            // placeholders for Lexer::uniqueId(), in order
+    Array generatedIds;         // placeholders for Identifier::generateId()
+
+    Preparse();
+    static int fail();
+    Identifier *placeholder(Array *ids, const char *prefix);
+    int commit();
+};
+#endif
+
 #endif /* DMD_LEXER_H */
@@ -193,6 +193,10 @@ void errorSupplemental(Loc loc, const char *format, ...)
 
 void verror(Loc loc, const char *format, va_list ap)
 {
+#if IN_LLVM
+    if (Preparse::fail())
+        return;
+#endif
     if (!global.gag)
     {
         char *p = loc.toChars();
@@ -224,6 +228,10 @@ void verror(Loc loc, const char *format, va_list ap)
 // Doesn't increase error count, doesn't print "Error:".
 void verrorSupplemental(Loc loc, const char *format, va_list ap)
 {
+#if IN_LLVM
+    if (Preparse::fail())
+        return;
+#endif
     if (!global.gag)
     {
         fprintf(stdmsg, "%s:        ", loc.toChars());
@@ -242,6 +250,10 @@ void verrorSupplemental(Loc loc, const char *format, va_list ap)
 
 void vwarning(Loc loc, const char *format, va_list ap)
 {
+#if IN_LLVM
+    if (global.params.warnings && Preparse::fail())
+        return;
+#endif
     if (global.params.warnings && !global.gag)
     {
         char *p = loc.toChars();
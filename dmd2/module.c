@@ -218,6 +218,7 @@ Module::Module(char *filename, Identifier *ident, int doDocComment, int doHdrGen
     this->doHdrGen = doHdrGen;
     this->isRoot = false;
     this->arrayfuncs = 0;
+    this->preparsed = NULL;
 #endif
 }
 #if IN_LLVM
@@ -520,7 +521,17 @@ Module *Module::load(Loc loc, Identifiers *packages, Identifier *ident)
 void Module::read(Loc loc)
 {
     //printf("Module::read('%s') file '%s'\n", toChars(), srcfile->toChars());
+#if IN_LLVM
+    if (srcfile->buffer)        // by preparse()
+        return;
+#if POSIX
+    if (srcfile->mmread())
+#else
     if (srcfile->read())
+#endif
+#else
+    if (srcfile->read())
+#endif
     {   error(loc, "is in file '%s' which cannot be read", srcfile->toChars());
         if (!global.gag)
         {   /* Print path
@@ -575,6 +586,44 @@ inline unsigned readlongBE(unsigned *p)
 }
 
 #if IN_LLVM
+/**************************************
+ * Read and parse a root module ahead of parse(), on one of several threads
+ * (see the driver). Only plain UTF-8 D source is handled here; parse() does
+ * all the work for the other files and for modules that fail to preparse.
+ */
+
+void Module::preparse(bool gen_docs)
+{
+    if (srcfile->mmread())
+        return;                 // read() reports it
+
+    unsigned char *buf = srcfile->buffer;
+    unsigned buflen = srcfile->len;
+
+    /* The checks of parse() that don't lead to a conversion pass if the
+     * file starts with two non-zero ASCII characters.
+     */
+    if (isHtml || buflen < 4 || !buf[0] || buf[0] >= 0x80 || !buf[1] ||
+        memcmp(buf, "Ddoc", 4) == 0)
+        return;
+
+    Preparse *pp = new Preparse();
+    Preparse::current = pp;
+    {
+        Parser p(this, buf, buflen, gen_docs);
+        p.nextToken();
+        members = p.parseModule();
+        md = p.md;
+        numlines = p.loc.linnum;
+    }
+    Preparse::current = NULL;
+
+    if (pp->failed)
+        delete pp;
+    else
+        preparsed = pp;
+}
+
 void Module::parse(bool gen_docs)
 #elif IN_GCC
 void Module::parse(bool dump_source)
@@ -790,10 +839,23 @@ void Module::parse()
 #endif
     }
 #if IN_LLVM
-    Parser p(this, buf, buflen, gen_docs);
+    /* A module parsed by preparse() ends up with the same tree once the
+     * identifiers generated for it are numbered in module order.
+     */
+    if (!preparsed || !preparsed->commit())
+    {
+        Parser p(this, buf, buflen, gen_docs);
+        p.nextToken();
+        members = p.parseModule();
+        md = p.md;
+        numlines = p.loc.linnum;
+    }
+    delete preparsed;
+    preparsed = NULL;
+
+    srcfile->freeBuffer();
 #else
     Parser p(this, buf, buflen, docfile != NULL);
-#endif
     p.nextToken();
     members = p.parseModule();
 
@@ -803,6 +865,7 @@ void Module::parse()
 
     md = p.md;
     numlines = p.loc.linnum;
+#endif
 
     DsymbolTable *dst;
 
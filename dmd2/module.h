@@ -25,6 +25,9 @@ struct Macro;
 struct Escape;
 struct VarDeclaration;
 struct Library;
+#if IN_LLVM
+struct Preparse;
+#endif
 
 // Back end
 #if IN_LLVM
@@ -140,6 +143,7 @@ struct Module : Package
 #endif
     void read(Loc loc); // read file
 #if IN_LLVM
+    void preparse(bool gen_docs = false);    // read and parse on another thread
     void parse(bool gen_docs = false);       // syntactic parse
 #elif IN_GCC
     void parse(bool dump_source = false);       // syntactic parse
@@ -214,6 +218,9 @@ struct Module : Package
     AA *arrayfuncs;
 
     bool isRoot;
+
+    // the result of preparse(), used by parse()
+    Preparse *preparsed;
 #endif
 };
 
@@ -13,12 +13,121 @@
 #endif
 
 /* This implementation of the storage allocator uses the standard C allocation package.
+ *
+ * On 64 bit POSIX hosts, small blocks are instead bump allocated from an
+ * arena: a large reserved address range that is handed out to the threads
+ * in huge page sized chunks. Almost nothing the compiler allocates is ever
+ * freed, so this avoids the time and space malloc spends on bookkeeping.
+ * Blocks in the arena have no size header; a block that is realloc'ed
+ * moves to the C heap unless it is the last one allocated by its thread.
  */
 
+#if (linux || __APPLE__ || __FreeBSD__ || __OpenBSD__) && __GNUC__ && __LP64__
+#define USE_ARENA 1
+#include <sys/mman.h>
+#endif
+
 Mem mem;
 
+#if USE_ARENA
+
+#define ARENA_RESERVE   ((size_t)64 << 30)      // address space reserved for the arena
+#define ARENA_CHUNK     ((size_t)2 << 20)       // a huge page
+#define ARENA_MAXBLOCK  (ARENA_CHUNK / 16)      // larger blocks come from malloc
+#define ARENA_ALIGN     16
+
+static char *arenaBase;         // NULL if the arena is not used
+static size_t arenaNextChunk;   // offset of the next unused chunk
+
+static __thread char *chunkNext;        // free space in this thread's chunk
+static __thread char *chunkEnd;
+static __thread char *lastBlock;        // last block allocated by this thread
+
+// statistics, collected per thread and added up when a thread takes a new
+// chunk or calls Mem::flushStats()
+static __thread size_t threadAllocs;
+static __thread size_t threadBytes;
+static size_t arenaAllocs;
+static size_t arenaBytes;
+static size_t heapAllocs;
+static size_t heapBytes;
+
+static inline bool isArenaBlock(void *p)
+{
+    return arenaBase && (size_t)((char *)p - arenaBase) < ARENA_RESERVE;
+}
+
+static void flushArenaStats()
+{
+    __sync_fetch_and_add(&arenaAllocs, threadAllocs);
+    __sync_fetch_and_add(&arenaBytes, threadBytes);
+    threadAllocs = 0;
+    threadBytes = 0;
+}
+
+static bool newChunk()
+{
+    size_t offset = __sync_fetch_and_add(&arenaNextChunk, ARENA_CHUNK);
+    if (offset + ARENA_CHUNK > ARENA_RESERVE)
+        return false;
+    flushArenaStats();
+    chunkNext = arenaBase + offset;
+    chunkEnd = chunkNext + ARENA_CHUNK;
+    lastBlock = NULL;
+    return true;
+}
+
+static void *arenaMalloc(size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (size > (size_t)(chunkEnd - chunkNext) && !newChunk())
+        return NULL;
+    char *p = chunkNext;
+    chunkNext += size;
+    lastBlock = p;
+    threadAllocs++;
+    threadBytes += size;
+    return p;
+}
+
+#endif
+
 void Mem::init()
 {
+#if USE_ARENA
+    if (arenaBase)
+        return;
+    // Pages are only backed by memory once they are touched.
+    void *p = mmap(NULL, ARENA_RESERVE + ARENA_CHUNK, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+        return;
+    arenaBase = (char *)(((size_t)p + ARENA_CHUNK - 1) & ~(ARENA_CHUNK - 1));
+#ifdef MADV_HUGEPAGE
+    madvise(arenaBase, ARENA_RESERVE, MADV_HUGEPAGE);
+#endif
+#endif
+}
+
+void Mem::printStats()
+{
+#if USE_ARENA
+    if (arenaBase)
+    {
+        flushArenaStats();
+        size_t chunks = arenaNextChunk / ARENA_CHUNK;
+        printf("memory   arena %lu blocks, %lu KB in %lu chunks; malloc %lu blocks, %lu KB\n",
+            (unsigned long)arenaAllocs, (unsigned long)(arenaBytes >> 10),
+            (unsigned long)chunks, (unsigned long)heapAllocs, (unsigned long)(heapBytes >> 10));
+    }
+#endif
+}
+
+void Mem::flushStats()
+{
+#if USE_ARENA
+    flushArenaStats();
+#endif
 }
 
 char *Mem::strdup(const char *s)
@@ -27,10 +136,10 @@ char *Mem::strdup(const char *s)
 
     if (s)
     {
-        p = ::strdup(s);
-        if (p)
-            return p;
-        error();
+        size_t len = strlen(s) + 1;
+        p = (char *)malloc(len);
+        memcpy(p, s, len);
+        return p;
     }
     return NULL;
 }
@@ -42,6 +151,12 @@ void *Mem::malloc(size_t size)
         p = NULL;
     else
     {
+#if USE_ARENA
+        if (size <= ARENA_MAXBLOCK && arenaBase && (p = arenaMalloc(size)) != NULL)
+            return p;
+        __sync_fetch_and_add(&heapAllocs, 1);
+        __sync_fetch_and_add(&heapBytes, size);
+#endif
         p = ::malloc(size);
         if (!p)
             error();
@@ -56,6 +171,15 @@ void *Mem::calloc(size_t size, size_t n)
         p = NULL;
     else
     {
+        if (size > (size_t)-1 / n)
+            error();
+#if USE_ARENA
+        if (size * n <= ARENA_MAXBLOCK && arenaBase && (p = arenaMalloc(size * n)) != NULL)
+        {   // the block may have been freed and reused
+            memset(p, 0, size * n);
+            return p;
+        }
+#endif
         p = ::calloc(size, n);
         if (!p)
             error();
@@ -65,6 +189,32 @@ void *Mem::calloc(size_t size, size_t n)
 
 void *Mem::realloc(void *p, size_t size)
 {
+#if USE_ARENA
+    if (p && isArenaBlock(p))
+    {
+        if (!size)
+        {   free(p);
+            return NULL;
+        }
+        size_t asize = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+        if (p == lastBlock && asize <= (size_t)(chunkEnd - (char *)p))
+        {   // grow or shrink in place
+            threadBytes += asize - (chunkNext - (char *)p);
+            chunkNext = (char *)p + asize;
+            return p;
+        }
+        // The old size is unknown, but copying up to the end of its chunk
+        // stays inside the arena.
+        void *q = ::malloc(size);
+        if (!q)
+            error();
+        size_t avail = ARENA_CHUNK - ((size_t)p & (ARENA_CHUNK - 1));
+        memcpy(q, p, size < avail ? size : avail);
+        __sync_fetch_and_add(&heapAllocs, 1);
+        __sync_fetch_and_add(&heapBytes, size);
+        return q;
+    }
+#endif
     if (!size)
     {   if (p)
         {   ::free(p);
@@ -91,6 +241,17 @@ void *Mem::realloc(void *p, size_t size)
 
 void Mem::free(void *p)
 {
+#if USE_ARENA
+    if (p && isArenaBlock(p))
+    {   // only the last block of this thread can be reused
+        if (p == lastBlock)
+        {   threadBytes -= chunkNext - (char *)p;
+            chunkNext = (char *)p;
+            lastBlock = NULL;
+        }
+        return;
+    }
+#endif
     if (p)
         ::free(p);
 }
@@ -102,11 +263,8 @@ void *Mem::mallocdup(void *o, size_t size)
         p = NULL;
     else
     {
-        p = ::malloc(size);
-        if (!p)
-            error();
-        else
-            memcpy(p,o,size);
+        p = malloc(size);
+        memcpy(p,o,size);
     }
     return p;
 }
@@ -16,6 +16,8 @@ struct Mem
     Mem() { gc = NULL; }
 
     void init();
+    void printStats();          // print allocation statistics
+    void flushStats();          // add this thread's statistics to the totals, call before it exits
 
     // Derive from Mem to get these storage allocators instead of global new/delete
     void * operator new(size_t m_size);
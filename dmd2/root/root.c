@@ -45,6 +45,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <utime.h>
+#include <sys/mman.h>
 #endif
 
 #include "port.h"
@@ -181,6 +182,16 @@ void warning(const char *format, ...)
 
 /****************************** Object ********************************/
 
+void *Object::operator new(size_t size)
+{
+    return mem.malloc(size);
+}
+
+void Object::operator delete(void *p)
+{
+    mem.free(p);
+}
+
 int Object::equals(Object *o)
 {
     return o == this;
@@ -1051,12 +1062,34 @@ File::~File()
 #if _WIN32
         else if (ref == 2)
             UnmapViewOfFile(buffer);
+#elif POSIX
+        else if (ref == 2)
+            munmap(buffer, len);
 #endif
     }
     if (touchtime)
         mem.free(touchtime);
 }
 
+void File::freeBuffer()
+{
+    if (buffer)
+    {
+        if (ref == 0)
+            ::free(buffer);
+#if _WIN32
+        else if (ref == 2)
+            UnmapViewOfFile(buffer);
+#elif POSIX
+        else if (ref == 2)
+            munmap(buffer, len);
+#endif
+    }
+    ref = 0;
+    buffer = NULL;
+    len = 0;
+}
+
 void File::mark()
 {
     mem.mark(buffer);
@@ -1203,6 +1236,45 @@ err1:
 int File::mmread()
 {
 #if POSIX
+    off_t size;
+    int fd;
+    struct stat buf;
+    long pagesize;
+    void *p;
+    char *name;
+
+    name = this->name->toChars();
+    fd = open(name, O_RDONLY);
+    if (fd == -1)
+        return 1;
+    if (fstat(fd, &buf))
+        goto Lread;
+    size = buf.st_size;
+
+    /* The scanner needs two 0 bytes past the end of the buffer. A private
+     * mapping reads as 0 up to the end of the last page, so map the file
+     * only if there are at least two bytes left there; otherwise read it.
+     */
+    pagesize = sysconf(_SC_PAGESIZE);
+    if (pagesize <= 0 || size % pagesize == 0 || pagesize - size % pagesize < 2)
+        goto Lread;
+
+    // Writable, so that the buffer can be treated as the one of read().
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+        goto Lread;
+    close(fd);
+
+    freeBuffer();
+    ref = 2;
+    buffer = (unsigned char *)p;
+    len = size;
+    if (touchtime)
+        memcpy(touchtime, &buf, sizeof(buf));
+    return 0;
+
+Lread:
+    close(fd);
     return read();
 #elif _WIN32
     HANDLE hFile;
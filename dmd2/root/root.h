@@ -75,6 +75,11 @@ struct Object
     Object() { }
     virtual ~Object() { }
 
+    // Allocate with mem instead of the global operator new, which is
+    // also used by the backend.
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
+
     virtual int equals(Object *o);
 
     /**
@@ -191,10 +196,16 @@ struct File : Object
     void readv();
 
     /* Read file, return !=0 if error
+     * On POSIX hosts the buffer is followed by two 0 bytes, as with read().
      */
 
     int mmread();
 
+    /* Release the buffer of read() or mmread().
+     */
+
+    void freeBuffer();
+
     /* Write file, either succeed or fail
      * with error message & exit.
      */
@@ -18,86 +18,120 @@
 #include "lstring.h"
 #include "stringtable.h"
 
-void StringTable::init(unsigned size)
-{
-    table = (void **)mem.calloc(size, sizeof(void *));
-    tabledim = size;
-    count = 0;
-}
-
-StringTable::~StringTable()
-{
-    unsigned i;
-
-    // Zero out dangling pointers to help garbage collector.
-    // Should zero out StringEntry's too.
-    for (i = 0; i < count; i++)
-        table[i] = NULL;
-
-    mem.free(table);
-    table = NULL;
-}
-
 struct StringEntry
 {
-    StringEntry *left;
-    StringEntry *right;
-    hash_t hash;
-
     StringValue value;
 
     static StringEntry *alloc(const dchar *s, unsigned len);
 };
 
+/* Entries are never freed, so they come from mem, which bump allocates
+ * small blocks from its arena where it has one.
+ */
+
 StringEntry *StringEntry::alloc(const dchar *s, unsigned len)
 {
     StringEntry *se;
 
-    se = (StringEntry *) mem.calloc(1,sizeof(StringEntry) - sizeof(Lstring) + Lstring::size(len));
+    se = (StringEntry *) mem.malloc(sizeof(StringEntry) - sizeof(Lstring) + Lstring::size(len));
+    se->value.ptrvalue = NULL;
     se->value.lstring.length = len;
-    se->hash = Dchar::calcHash(s,len);
     memcpy(se->value.lstring.string, s, len * sizeof(dchar));
+    se->value.lstring.string[len] = 0;
     return se;
 }
 
-void **StringTable::search(const dchar *s, unsigned len)
+/* Dchar::calcHash() leaves the low bits to the last characters; mix them
+ * with the others, as the slot is picked by the low bits.
+ */
+
+static hash_t calcHash(const dchar *s, unsigned len)
+{
+    unsigned h = Dchar::calcHash(s, len);
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+void StringTable::init(unsigned size)
+{
+    tabledim = 16;
+    while (tabledim < size)
+        tabledim <<= 1;
+    table = (StringSlot *)mem.calloc(tabledim, sizeof(StringSlot));
+    count = 0;
+    searches = 0;
+    probes = 0;
+    maxprobes = 0;
+    grows = 0;
+}
+
+StringTable::~StringTable()
+{
+    mem.free(table);
+    table = NULL;
+}
+
+/* Return the slot of s, or the free slot where it belongs.
+ * The probe sequence visits every slot, as tabledim is a power of 2.
+ */
+
+StringSlot *StringTable::search(const dchar *s, unsigned len, hash_t hash)
 {
-    hash_t hash;
-    unsigned u;
-    int cmp;
-    StringEntry **se;
+    unsigned mask = tabledim - 1;
+    unsigned u = hash & mask;
+    unsigned n;
 
     //printf("StringTable::search(%p,%d)\n",s,len);
-    hash = Dchar::calcHash(s,len);
-    u = hash % tabledim;
-    se = (StringEntry **)&table[u];
-    //printf("\thash = %d, u = %d\n",hash,u);
-    while (*se)
+    searches++;
+    for (n = 0; 1; n++)
     {
-        cmp = (*se)->hash - hash;
-        if (cmp == 0)
-        {
-            cmp = (*se)->value.lstring.len() - len;
-            if (cmp == 0)
-            {
-                cmp = Dchar::memcmp(s,(*se)->value.lstring.toDchars(),len);
-                if (cmp == 0)
-                    break;
-            }
-        }
-        if (cmp < 0)
-            se = &(*se)->left;
-        else
-            se = &(*se)->right;
+        StringSlot *slot = &table[u];
+        StringEntry *se = slot->entry;
+        if (!se)
+            break;
+        if (slot->hash == hash &&
+            se->value.lstring.len() == len &&
+            Dchar::memcmp(s, se->value.lstring.toDchars(), len) == 0)
+            break;
+        u = (u + n + 1) & mask;
     }
-    //printf("\treturn %p, %p\n",se, (*se));
-    return (void **)se;
+    probes += n;
+    if (n > maxprobes)
+        maxprobes = n;
+    return &table[u];
 }
 
-StringValue *StringTable::lookup(const dchar *s, unsigned len)
-{   StringEntry *se;
+void StringTable::grow()
+{
+    StringSlot *oldtable = table;
+    unsigned olddim = tabledim;
+
+    tabledim = olddim * 2;
+    table = (StringSlot *)mem.calloc(tabledim, sizeof(StringSlot));
+    grows++;
 
-    se = *(StringEntry **)search(s,len);
+    unsigned mask = tabledim - 1;
+    for (unsigned i = 0; i < olddim; i++)
+    {
+        if (!oldtable[i].entry)
+            continue;
+        // All entries are different, only a free slot needs to be found.
+        unsigned u = oldtable[i].hash & mask;
+        for (unsigned n = 0; table[u].entry; n++)
+            u = (u + n + 1) & mask;
+        table[u] = oldtable[i];
+    }
+    mem.free(oldtable);
+}
+
+StringValue *StringTable::lookup(const dchar *s, unsigned len)
+{
+    StringEntry *se = search(s, len, calcHash(s, len))->entry;
     if (se)
         return &se->value;
     else
@@ -105,35 +139,41 @@ StringValue *StringTable::lookup(const dchar *s, unsigned len)
 }
 
 StringValue *StringTable::update(const dchar *s, unsigned len)
-{   StringEntry **pse;
-    StringEntry *se;
-
-    pse = (StringEntry **)search(s,len);
-    se = *pse;
-    if (!se)                    // not in table: so create new entry
+{
+    hash_t hash = calcHash(s, len);
+    StringSlot *slot = search(s, len, hash);
+    if (!slot->entry)           // not in table: so create new entry
     {
-        se = StringEntry::alloc(s, len);
-        *pse = se;
+        if ((count + 1) * 4 > tabledim * 3)
+        {   grow();
+            slot = search(s, len, hash);
+        }
+        slot->hash = hash;
+        slot->entry = StringEntry::alloc(s, len);
+        count++;
     }
-    return &se->value;
+    return &slot->entry->value;
 }
 
 StringValue *StringTable::insert(const dchar *s, unsigned len)
-{   StringEntry **pse;
-    StringEntry *se;
-
-    pse = (StringEntry **)search(s,len);
-    se = *pse;
-    if (se)
+{
+    hash_t hash = calcHash(s, len);
+    StringSlot *slot = search(s, len, hash);
+    if (slot->entry)
         return NULL;            // error: already in table
-    else
-    {
-        se = StringEntry::alloc(s, len);
-        *pse = se;
+    if ((count + 1) * 4 > tabledim * 3)
+    {   grow();
+        slot = search(s, len, hash);
     }
-    return &se->value;
+    slot->hash = hash;
+    slot->entry = StringEntry::alloc(s, len);
+    count++;
+    return &slot->entry->value;
 }
 
-
-
-
+void StringTable::printStats(const char *name)
+{
+    printf("%-9s%u entries in %u slots, %u searches, %.2f probes per search (max %u), %u grows\n",
+        name, count, tabledim, searches,
+        searches ? (double)probes / searches : 0.0, maxprobes, grows);
+}
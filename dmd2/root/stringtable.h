@@ -28,11 +28,29 @@ struct StringValue
     Lstring lstring;
 };
 
+struct StringEntry;
+
+struct StringSlot
+{
+    hash_t hash;                // of entry, so that most mismatches don't touch it
+    StringEntry *entry;         // NULL if the slot is free
+};
+
+/* Open addressing hash table, which doubles in size once it is 3/4 full.
+ * The StringValue's stay where they are when it does.
+ */
+
 struct StringTable
 {
-    void **table;
+    StringSlot *table;
     unsigned count;
-    unsigned tabledim;
+    unsigned tabledim;          // a power of 2
+
+    // statistics
+    unsigned searches;
+    unsigned probes;            // occupied slots passed over by searches
+    unsigned maxprobes;
+    unsigned grows;
 
     void init(unsigned size = 37);
     ~StringTable();
@@ -41,8 +59,11 @@ struct StringTable
     StringValue *insert(const dchar *s, unsigned len);
     StringValue *update(const dchar *s, unsigned len);
 
+    void printStats(const char *name);
+
 private:
-    void **search(const dchar *s, unsigned len);
+    StringSlot *search(const dchar *s, unsigned len, hash_t hash);
+    void grow();
 };
 
 #endif
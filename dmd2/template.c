@@ -29,6 +29,9 @@
 #include "declaration.h"
 #include "dsymbol.h"
 #include "hdrgen.h"
+#if IN_LLVM
+#include "driver/timetrace.h"
+#endif
 #include "id.h"
 
 #if WINDOWS_SEH
@@ -278,6 +281,154 @@ int arrayObjectMatch(Objects *oa1, Objects *oa2, TemplateDeclaration *tempdecl,
     return 1;
 }
 
+/************************************
+ * Compute a hash of a template argument that is consistent with match():
+ * if match(o1, o2) then o1 and o2 have the same hash.
+ * Returns 0 if no such hash can be computed, e.g. for types that
+ * have not been run through semantic() yet.
+ */
+
+static int objectHash(Object *o, hash_t *phash)
+{
+    Type *t = isType(o);
+    Expression *e = isExpression(o);
+    Dsymbol *s = isDsymbol(o);
+    Tuple *u = isTuple(o);
+    hash_t h;
+
+    if (s)
+    {
+        VarDeclaration *v = s->isVarDeclaration();
+        if (v && v->storage_class & STCmanifest)
+        {   ExpInitializer *ei = v->init->isExpInitializer();
+            if (ei)
+                e = ei->exp, s = NULL;
+        }
+    }
+
+    if (t)
+    {
+        if (t->ty == Ttuple)
+        {   // TypeTuple::equals() compares the argument types
+            TypeTuple *tt = (TypeTuple *)t;
+            h = Ttuple;
+            for (size_t i = 0; i < tt->arguments->dim; i++)
+            {   hash_t ha;
+                if (!objectHash(tt->arguments->tdata()[i]->type, &ha))
+                    return 0;
+                h = h * 37 + ha;
+            }
+        }
+        else
+        {   // deco strings are unique, see Type::equals()
+            if (!t->deco)
+                return 0;
+            h = (hash_t)t->deco;
+        }
+    }
+    else if (e)
+    {
+        h = e->op;
+        switch (e->op)
+        {
+            case TOKint64:
+                h = h * 37 + (hash_t)((IntegerExp *)e)->value;
+                break;
+            case TOKstring:
+                h = h * 37 + ((StringExp *)e)->len;
+                break;
+            case TOKvar:
+                h = h * 37 + (hash_t)((VarExp *)e)->var;
+                break;
+            case TOKtuple:
+                h = h * 37 + ((TupleExp *)e)->exps->dim;
+                break;
+            case TOKfloat64:
+            case TOKcomplex80:
+            case TOKnull:
+                break;
+            default:
+                // No equals() override, only identical expressions match
+                h = h * 37 + (hash_t)e;
+                break;
+        }
+    }
+    else if (s)
+    {
+        if (!s->parent)
+            return 0;
+        h = (hash_t)s->parent;
+        if (s->ident)
+            h = h * 37 + s->ident->hashCode();
+        else
+            h = h * 37 + (hash_t)s;
+    }
+    else if (u)
+    {
+        h = u->objects.dim;
+        for (size_t i = 0; i < u->objects.dim; i++)
+        {   hash_t hu;
+            if (!objectHash(u->objects.tdata()[i], &hu))
+                return 0;
+            h = h * 37 + hu;
+        }
+    }
+    else
+        return 0;       // match() matches anything to it
+
+    *phash = h;
+    return 1;
+}
+
+static int arrayObjectHash(Objects *oa, hash_t *phash)
+{
+    hash_t h = oa->dim;
+    for (size_t j = 0; j < oa->dim; j++)
+    {   hash_t ho;
+        if (!objectHash(oa->tdata()[j], &ho))
+            return 0;
+        h = h * 37 + ho;
+    }
+    *phash = h;
+    return 1;
+}
+
+/************************************
+ * Return !=0 if comparing o against an instance of tempdecl with match()
+ * could give the "recursive template expansion" error.
+ */
+
+static int isRecursiveExpansion(Object *o, TemplateDeclaration *tempdecl, Scope *sc)
+{
+    Type *t = isType(o);
+    Tuple *u = isTuple(o);
+
+    if (t)
+    {
+        Dsymbol *s = t->toDsymbol(sc);
+        if (s && s->parent)
+        {   TemplateInstance *ti = s->parent->isTemplateInstance();
+            if (ti && ti->tempdecl == tempdecl)
+            {
+                for (Scope *sc1 = sc; sc1; sc1 = sc1->enclosing)
+                {
+                    if (sc1->scopesym == ti)
+                        return 1;
+                }
+            }
+        }
+    }
+    else if (u)
+    {
+        for (size_t i = 0; i < u->objects.dim; i++)
+        {
+            if (isRecursiveExpansion(u->objects.tdata()[i], tempdecl, sc))
+                return 1;
+        }
+    }
+    return 0;
+}
+
 /****************************************
  * This makes a 'pretty' version of the template arguments.
  * It's analogous to genIdent() which makes a mangled version.
@@ -384,6 +535,8 @@ TemplateDeclaration::TemplateDeclaration(Loc loc, Identifier *id,
     this->literal = 0;
     this->ismixin = ismixin;
     this->previous = NULL;
+    this->instanceBuckets = NULL;
+    this->unhashedInstances = 0;
 
     // Compute in advance for Ddoc's use
     if (members)
@@ -4208,6 +4361,8 @@ TemplateInstance::TemplateInstance(Loc loc, Identifier *ident)
     this->errors = 0;
     this->speculative = 0;
     this->ignore = true;
+    this->hashed = 0;
+    this->hash = 0;
 
 #if IN_LLVM
     this->emittedInModule = NULL;
@@ -4243,6 +4398,8 @@ TemplateInstance::TemplateInstance(Loc loc, TemplateDeclaration *td, Objects *ti
     this->errors = 0;
     this->speculative = 0;
     this->ignore = true;
+    this->hashed = 0;
+    this->hash = 0;
 
 #if IN_LLVM
     this->tinst = NULL;
@@ -4292,6 +4449,9 @@ void TemplateInstance::semantic(Scope *sc)
 void TemplateInstance::semantic(Scope *sc, Expressions *fargs)
 {
     //printf("TemplateInstance::semantic('%s', this=%p, gag = %d, sc = %p)\n", toChars(), this, global.gag, sc);
+#if IN_LLVM
+    TimeTraceScope timeScope("Template", timeTraceEnabled ? toChars() : NULL);
+#endif
     if (global.errors && name != Id::AssociativeArray)
     {
         //printf("not instantiating %s due to %d errors\n", toChars(), global.errors);
@@ -4387,11 +4547,28 @@ void TemplateInstance::semantic(Scope *sc, Expressions *fargs)
 
     /* See if there is an existing TemplateInstantiation that already
      * implements the typeargs. If so, just refer to that one instead.
+     * Only the instances with the same hash of tdtypes[] can match,
+     * unless a hash could not be computed for all of them or match()
+     * would diagnose a recursive expansion.
      */
 
-    for (size_t i = 0; i < tempdecl->instances.dim; i++)
+    TemplateInstances *candidates = &tempdecl->instances;
+    hashed = arrayObjectHash(&tdtypes, &hash);
+    if (hashed && !tempdecl->unhashedInstances && tempdecl->instances.dim)
+    {
+        size_t j;
+        for (j = 0; j < tdtypes.dim; j++)
+        {
+            if (isRecursiveExpansion(tdtypes.tdata()[j], tempdecl, sc))
+                break;
+        }
+        if (j == tdtypes.dim)
+            candidates = (TemplateInstances *)_aaGetRvalue(tempdecl->instanceBuckets, (void *)hash);
+    }
+
+    for (size_t i = 0; candidates && i < candidates->dim; i++)
     {
-        TemplateInstance *ti = tempdecl->instances.tdata()[i];
+        TemplateInstance *ti = candidates->tdata()[i];
 #if LOG
         printf("\t%s: checking for match with instance %d (%p): '%s'\n", toChars(), i, ti, ti->toChars());
 #endif
@@ -4485,6 +4662,14 @@ void TemplateInstance::semantic(Scope *sc, Expressions *fargs)
 
     int tempdecl_instance_idx = tempdecl->instances.dim;
     tempdecl->instances.push(this);
+    if (hashed)
+    {   TemplateInstances **pbucket = (TemplateInstances **)_aaGet(&tempdecl->instanceBuckets, (void *)hash);
+        if (!*pbucket)
+            *pbucket = new TemplateInstances();
+        (*pbucket)->push(this);
+    }
+    else
+        tempdecl->unhashedInstances++;
     parent = tempdecl->parent;
     //printf("parent = '%s'\n", parent->kind());
 
@@ -4788,6 +4973,18 @@ void TemplateInstance::semantic(Scope *sc, Expressions *fargs)
             // finish clean and so we can try to instantiate it again later
             // (see bugzilla 4302 and 6602).
             tempdecl->instances.remove(tempdecl_instance_idx);
+            if (hashed)
+            {   TemplateInstances *bucket = (TemplateInstances *)_aaGetRvalue(tempdecl->instanceBuckets, (void *)hash);
+                for (size_t i = bucket->dim; i--; )
+                {
+                    if (bucket->tdata()[i] == this)
+                    {   bucket->remove(i);
+                        break;
+                    }
+                }
+            }
+            else
+                tempdecl->unhashedInstances--;
             if (target_symbol_list)
             {
                 // Because we added 'this' in the last position above, we
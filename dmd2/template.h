@@ -57,6 +57,9 @@ struct TemplateDeclaration : ScopeDsymbol
     TemplateParameters *origParameters; // originals for Ddoc
     Expression *constraint;
     TemplateInstances instances;        // array of TemplateInstance's
+    AA *instanceBuckets;                // TemplateInstances of instances, indexed by
+                                        // the hash of their tdtypes[]
+    size_t unhashedInstances;           // number of instances not in instanceBuckets
 
     TemplateDeclaration *overnext;      // next overloaded TemplateDeclaration
     TemplateDeclaration *overroot;      // first in overnext list
@@ -307,6 +310,8 @@ struct TemplateInstance : ScopeDsymbol
     int errors;         // 1 if compiled with errors
     int speculative;    // 1 if only instantiated with errors gagged
     bool ignore;        // true if the instance must be ignored when codegen'ing
+    int hashed;         // 1 if hash is valid and this is in tempdecl->instanceBuckets
+    hash_t hash;        // hash of tdtypes[]
 #ifdef IN_GCC
     /* On some targets, it is necessary to know whether a symbol
        will be emitted in the output or not before the symbol
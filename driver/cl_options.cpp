@@ -383,10 +383,27 @@ cl::opt<bool, true> singleObj("singleobj",
     cl::desc("Create only a single output object file"),
     cl::location(global.params.singleObj));
 
+cl::opt<bool, true> dedupTemplates("dedup-templates",
+    cl::desc("Define each template instance only in the first module that uses it"),
+    cl::location(global.params.dedupTemplates));
+
 cl::opt<bool> linkonceTemplates("linkonce-templates",
     cl::desc("Use linkonce_odr linkage for template symbols instead of weak_odr"),
     cl::ZeroOrMore);
 
+cl::opt<unsigned> backendThreads("j",
+    cl::desc("Parse, optimize and generate code for up to <n> modules in parallel (0 = number of CPUs)"),
+    cl::value_desc("n"),
+    cl::Prefix,
+    cl::ZeroOrMore,
+    cl::init(1));
+
+cl::opt<unsigned> singleObjPartitions("singleobj-partitions",
+    cl::desc("Split the -singleobj module into <n> object files for parallel code generation (implies -j=<n>)"),
+    cl::value_desc("n"),
+    cl::ZeroOrMore,
+    cl::init(1));
+
 static cl::extrahelp footer("\n"
 "-d-debug can also be specified without options, in which case it enables all\n"
 "debug checks (i.e. (asserts, boundchecks, contracts and invariants) as well\n"
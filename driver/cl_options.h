@@ -52,6 +52,8 @@ namespace opts {
     extern cl::opt<llvm::CodeModel::Model> mCodeModel;
     extern cl::opt<bool, true> singleObj;
     extern cl::opt<bool> linkonceTemplates;
+    extern cl::opt<unsigned> backendThreads;
+    extern cl::opt<unsigned> singleObjPartitions;
 
     // Arguments to -d-debug
     extern std::vector<std::string> debugArgs;
@@ -1,7 +1,13 @@
 #include "gen/llvm.h"
 #include "llvm/Linker.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Analysis/Verifier.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Program.h"
+#include "llvm/Support/system_error.h"
 #if _WIN32
 #include "llvm/Support/SystemUtils.h"
 #endif
@@ -11,12 +17,14 @@
 #include "module.h"
 
 #define NO_COUT_LOGGER
+#include "gen/irstate.h"
 #include "gen/logger.h"
 #include "gen/optimizer.h"
 #include "gen/programs.h"
 
 #include "driver/linker.h"
 #include "driver/cl_options.h"
+#include "driver/toobj.h"
 
 //////////////////////////////////////////////////////////////////////////////
 
@@ -27,6 +35,11 @@ llvm::cl::opt<bool> quiet("quiet",
     llvm::cl::ZeroOrMore,
     llvm::cl::init(true));
 
+static llvm::cl::list<std::string> ltoExports("lto-export",
+    llvm::cl::desc("Keep the D symbol <symbol> visible to native code during link-time optimization"),
+    llvm::cl::value_desc("symbol,..."),
+    llvm::cl::CommaSeparated);
+
 //////////////////////////////////////////////////////////////////////////////
 
 bool endsWith(const std::string &str, const std::string &end)
@@ -46,12 +59,128 @@ void linkModules(llvm::Module* dst, const Module_vector& MV)
     std::string err;
     for (Module_vector::const_iterator i=MV.begin(); i!=MV.end(); ++i)
     {
-        if (!linker.LinkInModule(*i, &err))
+        if (linker.LinkInModule(*i, &err))
         {
             error("%s", err.c_str());
             fatal();
         }
     }
+
+    // the linker would delete dst otherwise
+    linker.releaseModule();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Adds the names of the symbols m defines that native code can refer to
+// without knowing the D mangling, i.e. those not declared extern(D).
+static void addForeignExports(llvm::Module* m, std::vector<std::string>& names)
+{
+    for (llvm::Module::iterator I = m->begin(), E = m->end(); I != E; ++I)
+        if (!I->isDeclaration() && !I->hasLocalLinkage() && !I->getName().startswith("_D"))
+            names.push_back(I->getName());
+    for (llvm::Module::global_iterator I = m->global_begin(), E = m->global_end(); I != E; ++I)
+        if (!I->isDeclaration() && !I->hasLocalLinkage() && !I->getName().startswith("_D"))
+            names.push_back(I->getName());
+}
+
+// -O4/-O5: Merges all bitcode object files into one module, optimizes it as
+// a whole and replaces them by a single native object file.
+// Returns the path of that object file, which the caller has to delete.
+static llvm::sys::Path linkTimeOptimize(std::vector<std::string>& objects, bool sharedLib)
+{
+    llvm::LLVMContext context;
+    llvm::Module* merged = NULL;
+    Module_vector modules;
+
+    std::vector<std::string> native;
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        llvm::sys::Path path(objects[i]);
+        if (!path.isBitcodeFile())
+        {
+            native.push_back(objects[i]);
+            continue;
+        }
+
+        Logger::println("Reading bitcode object %s", objects[i].c_str());
+        llvm::OwningPtr<llvm::MemoryBuffer> buffer;
+        std::string err;
+        llvm::Module* m = NULL;
+        if (llvm::error_code ec = llvm::MemoryBuffer::getFile(objects[i], buffer))
+            err = ec.message();
+        else
+            m = llvm::ParseBitcodeFile(buffer.get(), context, &err);
+        if (!m)
+        {
+            error("cannot read bitcode object '%s': %s", objects[i].c_str(), err.c_str());
+            fatal();
+        }
+
+        if (!merged)
+            merged = m;
+        else
+            modules.push_back(m);
+    }
+
+    llvm::sys::Path result;
+    if (!merged)
+        return result;
+
+    Logger::println("*** Link-time optimization ***");
+    linkModules(merged, modules);
+    for (size_t i = 0; i < modules.size(); i++)
+        delete modules[i];
+
+    // Shared libraries export everything. For executables, the native code
+    // references the extern(C) symbols by name, D symbols only by -lto-export
+    // and druntime calls _Dmain.
+    if (sharedLib)
+        ldc_optimize_lto_module(merged, NULL);
+    else
+    {
+        std::vector<std::string> foreign;
+        addForeignExports(merged, foreign);
+
+        std::vector<const char*> exports;
+        exports.push_back("_Dmain");
+        for (size_t i = 0; i < foreign.size(); i++)
+            exports.push_back(foreign[i].c_str());
+        for (size_t i = 0; i < ltoExports.size(); i++)
+            exports.push_back(ltoExports[i].c_str());
+        ldc_optimize_lto_module(merged, &exports);
+    }
+
+    if (!global.params.noVerify)
+    {
+        std::string verifyErr;
+        if (llvm::verifyModule(*merged, llvm::ReturnStatusAction, &verifyErr))
+        {
+            error("%s", verifyErr.c_str());
+            fatal();
+        }
+    }
+
+    result = llvm::sys::Path(objects[0]);
+    result.eraseSuffix();
+    result.appendSuffix("lto");
+    result.appendSuffix(std::string(global.obj_ext));
+    Logger::println("Writing link-time optimized object file to: %s", result.c_str());
+    {
+        std::string err;
+        llvm::raw_fd_ostream out(result.c_str(), err, llvm::raw_fd_ostream::F_Binary);
+        if (!err.empty())
+        {
+            error("cannot write object file: %s", err.c_str());
+            fatal();
+        }
+        emit_file(*gTargetMachine, *merged, out, llvm::TargetMachine::CGFT_ObjectFile);
+    }
+    delete merged;
+
+    native.push_back(result.str());
+    objects.swap(native);
+    return result;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -238,11 +367,16 @@ int linkObjToBinary(bool sharedLib)
     args.push_back(gccStr);
 
     // object files
+    std::vector<std::string> objects;
     for (unsigned i = 0; i < global.params.objfiles->dim; i++)
-    {
-        char *p = (char *)global.params.objfiles->data[i];
-        args.push_back(p);
-    }
+        objects.push_back((char *)global.params.objfiles->data[i]);
+
+    llvm::sys::Path ltoObject;
+    if (linkTimeOptimization() && !objects.empty())
+        ltoObject = linkTimeOptimize(objects, sharedLib);
+
+    for (size_t i = 0; i < objects.size(); i++)
+        args.push_back(objects[i].c_str());
 
     // output filename
     std::string output;
@@ -382,7 +516,12 @@ int linkObjToBinary(bool sharedLib)
     args.push_back(NULL);
 
     // try to call linker
-    if (int status = llvm::sys::Program::ExecuteAndWait(gcc, &args[0], NULL, NULL, 0,0, &errstr))
+    int status = llvm::sys::Program::ExecuteAndWait(gcc, &args[0], NULL, NULL, 0,0, &errstr);
+
+    if (!ltoObject.isEmpty())
+        ltoObject.eraseFromDisk();
+
+    if (status)
     {
         error("linking failed:\nstatus: %d", status);
         if (!errstr.empty())
@@ -36,15 +36,19 @@
 #include "gen/passes/Passes.h"
 
 #include "driver/linker.h"
+#include "driver/timetrace.h"
 #include "driver/cl_options.h"
 #include "gen/cl_helpers.h"
 using namespace opts;
 
 #include "driver/configfile.h"
+#include "driver/objcache.h"
 #include "driver/toobj.h"
 
 #if POSIX
 #include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 #elif _WIN32
 #include <windows.h>
 #endif
@@ -123,6 +127,77 @@ static void initFromString(char*& dest, const cl::opt<std::string>& src) {
     }
 }
 
+#if POSIX && DMDV2
+// Parallel parsing (-j).
+//
+// The root modules are read and parsed by worker threads before the main
+// thread calls parse() on each of them in order. Module::preparse() leaves
+// everything that depends on that order to parse(), so the trees are the
+// same as those of a serial parse.
+
+namespace {
+    struct PreparseQueue
+    {
+        pthread_mutex_t lock;
+        Modules* modules;
+        size_t next;
+    };
+}
+
+static void* preparseWorker(void* arg)
+{
+    PreparseQueue& queue = *static_cast<PreparseQueue*>(arg);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue.lock);
+        size_t i = queue.next++;
+        pthread_mutex_unlock(&queue.lock);
+        if (i >= queue.modules->dim)
+            break;
+        Module* m = (Module *)queue.modules->data[i];
+        m->preparse(global.params.doDocComments);
+    }
+    mem.flushStats();
+    return NULL;
+}
+
+static void preparseModules(Modules& modules)
+{
+    unsigned count = opts::backendThreads;
+    if (count == 0)
+    {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = ncpus > 0 ? ncpus : 1;
+    }
+    if (count > modules.dim)
+        count = modules.dim;
+    if (count < 2)
+        return;
+
+    TimeTraceScope timeScope("Preparse", NULL, true);
+
+    PreparseQueue queue;
+    pthread_mutex_init(&queue.lock, NULL);
+    queue.modules = &modules;
+    queue.next = 0;
+
+    // Modules no thread got to are simply parsed by the main thread.
+    std::vector<pthread_t> workers;
+    for (unsigned i = 0; i < count; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, &preparseWorker, &queue) != 0)
+            break;
+        workers.push_back(thread);
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+        pthread_join(workers[i], NULL);
+
+    pthread_mutex_destroy(&queue.lock);
+}
+#endif
+
 #if _WIN32 && __DMC__
 extern "C"
 {
@@ -266,10 +341,19 @@ int main(int argc, char** argv)
     global.params.output_ll = opts::output_ll ? OUTPUTFLAGset : OUTPUTFLAGno;
     global.params.output_s  = opts::output_s  ? OUTPUTFLAGset : OUTPUTFLAGno;
 
+    if (backendThreads.getNumOccurrences() == 0)
+        backendThreads = singleObjPartitions;
+
     templateLinkage =
         opts::linkonceTemplates ? LLGlobalValue::LinkOnceODRLinkage
                                 : LLGlobalValue::WeakODRLinkage;
 
+    // linkonce_odr definitions may be dropped from the module owning them
+    if (global.params.dedupTemplates && opts::linkonceTemplates) {
+        error("-dedup-templates and -linkonce-templates switches cannot be used together");
+        fatal();
+    }
+
     if (global.params.run || !runargs.empty()) {
         // FIXME: how to properly detect the presence of a PositionalEatsArgs
         // option without parameters? We want to emit an error in that case...
@@ -828,12 +912,17 @@ LDC_TARGETS
         modules.push(m);
     }
 
+#if POSIX && DMDV2
+    preparseModules(modules);
+#endif
+
     // Read files, parse them
     for (unsigned i = 0; i < modules.dim; i++)
     {
         m = (Module *)modules.data[i];
         if (global.params.verbose)
             printf("parse     %s\n", m->toChars());
+        TimeTraceScope timeScope("Parse", m->toChars(), true);
         if (!Module::rootModule)
             Module::rootModule = m;
         m->importedFrom = m;
@@ -877,6 +966,7 @@ LDC_TARGETS
        m = (Module *)modules.data[i];
        if (global.params.verbose)
            printf("importall %s\n", m->toChars());
+       TimeTraceScope timeScope("ImportAll", m->toChars(), true);
        m->importAll(0);
     }
     if (global.errors)
@@ -888,13 +978,17 @@ LDC_TARGETS
         m = (Module *)modules.data[i];
         if (global.params.verbose)
             printf("semantic  %s\n", m->toChars());
+        TimeTraceScope timeScope("Semantic1", m->toChars(), true);
         m->semantic();
     }
     if (global.errors)
         fatal();
 
-    Module::dprogress = 1;
-    Module::runDeferredSemantic();
+    {
+        TimeTraceScope timeScope("Semantic1", "deferred", true);
+        Module::dprogress = 1;
+        Module::runDeferredSemantic();
+    }
 
     // Do pass 2 semantic analysis
     for (unsigned i = 0; i < modules.dim; i++)
@@ -902,6 +996,7 @@ LDC_TARGETS
         m = (Module *)modules.data[i];
         if (global.params.verbose)
             printf("semantic2 %s\n", m->toChars());
+        TimeTraceScope timeScope("Semantic2", m->toChars(), true);
         m->semantic2();
     }
     if (global.errors)
@@ -913,6 +1008,7 @@ LDC_TARGETS
         m = (Module *)modules.data[i];
         if (global.params.verbose)
             printf("semantic3 %s\n", m->toChars());
+        TimeTraceScope timeScope("Semantic3", m->toChars(), true);
         m->semantic3();
     }
     if (global.errors)
@@ -943,6 +1039,7 @@ LDC_TARGETS
                 m = (Module *)Module::amodules.data[i];
                 if (global.params.verbose)
                     printf("semantic3 %s\n", m->toChars());
+                TimeTraceScope timeScope("Inline scan", m->toChars(), true);
                 m->semantic2();
                 m->semantic3();
             }
@@ -986,13 +1083,20 @@ LDC_TARGETS
             printf("code      %s\n", m->toChars());
         if (global.params.obj)
         {
-            llvm::Module* lm = m->genLLVMModule(context, &ir);
+            llvm::Module* lm;
+            {
+                TimeTraceScope timeScope("Codegen", m->toChars(), true);
+                lm = m->genLLVMModule(context, &ir);
+            }
             if (!singleObj)
             {
+                TimeTraceScope timeScope("Backend", m->toChars(), true);
                 m->deleteObjFile();
-                writeModule(lm, m->objfile->name->str);
+                if (objCacheFetch(lm, m->objfile->name->str))
+                    delete lm;
+                else
+                    writeModuleAsync(lm, m->objfile->name->str);
                 global.params.objfiles->push(m->objfile->name->str);
-                delete lm;
             }
             else
                 llvmModules.push_back(lm);
@@ -1006,9 +1110,17 @@ LDC_TARGETS
         }
     }
 
+    // wait for the backend threads
+    {
+        TimeTraceScope timeScope("Backend", NULL, true);
+        finishModuleWrites();
+        objCacheCommit();
+    }
+
     // internal linking for singleobj
     if (singleObj && llvmModules.size() > 0)
     {
+        TimeTraceScope timeScope("Backend", NULL, true);
         Module* m = (Module*)modules.data[0];
         char* name = m->toChars();
         char* filename = m->objfile->name->str;
@@ -1024,8 +1136,25 @@ LDC_TARGETS
         }
 
         m->deleteObjFile();
-        writeModule(linker.getModule(), filename);
-        global.params.objfiles->push(filename);
+
+        // Splitting only makes sense if all objects are passed on to the
+        // linker or archiver anyway, and breaks the debug info.
+        bool partition = singleObjPartitions > 1
+            && (global.params.link || createStaticLib)
+            && !global.params.symdebug
+            && !(global.params.output_bc || global.params.output_ll || global.params.output_s);
+        if (partition)
+        {
+            std::vector<std::string> objs = writeModulePartitioned(
+                linker.getModule(), filename, singleObjPartitions, name);
+            for (size_t i = 0; i < objs.size(); i++)
+                global.params.objfiles->push(mem.strdup(objs[i].c_str()));
+        }
+        else
+        {
+            writeModule(linker.getModule(), filename);
+            global.params.objfiles->push(filename);
+        }
     }
 
     // output json file
@@ -1036,6 +1165,16 @@ LDC_TARGETS
     if (global.errors)
         fatal();
 
+#if DMDV2
+    if (global.params.verbose)
+    {
+        mem.printStats();
+        Lexer::stringtable.printStats("idents");
+        Type::stringtable.printStats("types");
+        Type::deco_stringtable.printStats("decos");
+    }
+#endif
+
     if (!global.params.objfiles->dim)
     {
         if (global.params.link)
@@ -1045,10 +1184,13 @@ LDC_TARGETS
     }
     else
     {
-        if (global.params.link)
-            status = linkObjToBinary(createSharedLib);
-        else if (createStaticLib)
-            createStaticLibrary();
+        {
+            TimeTraceScope timeScope("Link", NULL, true);
+            if (global.params.link)
+                status = linkObjToBinary(createSharedLib);
+            else if (createStaticLib)
+                createStaticLibrary();
+        }
 
         if (global.params.run)
         {
@@ -1068,5 +1210,11 @@ LDC_TARGETS
         }
     }
 
+    if (timeTraceEnabled && modules.dim)
+    {
+        m = (Module *)modules.data[0];
+        timeTraceFinish(FileName::forceExt(m->objfile->name->str, "time-trace.json")->toChars());
+    }
+
     return status;
 }
@@ -0,0 +1,310 @@
+#include "driver/objcache.h"
+
+#include "llvm/Module.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include "root.h"
+#include "mars.h"
+
+#include "gen/irstate.h"
+#include "gen/logger.h"
+#include "gen/optimizer.h"
+
+#include "driver/toobj.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#if POSIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+static llvm::cl::opt<std::string> cacheDir("cache",
+    llvm::cl::desc("Reuse object files of unchanged modules from the cache in <dir>"),
+    llvm::cl::value_desc("dir"));
+
+static llvm::cl::opt<unsigned> cacheSize("cache-size",
+    llvm::cl::desc("Maximum size of the object cache in megabytes"),
+    llvm::cl::value_desc("MB"),
+    llvm::cl::init(1024));
+
+//////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    struct PendingEntry
+    {
+        std::string path;
+        std::string objfile;
+    };
+
+    struct CacheFile
+    {
+        std::string path;
+        time_t mtime;
+        off_t size;
+
+        bool operator<(const CacheFile& other) const
+        {
+            if (mtime != other.mtime)
+                return mtime < other.mtime;
+            return path < other.path;
+        }
+    };
+}
+
+static std::vector<PendingEntry> pendingEntries;
+static unsigned cacheHits = 0;
+static unsigned cacheMisses = 0;
+static unsigned cacheEvictions = 0;
+
+//////////////////////////////////////////////////////////////////////////////
+
+// FNV-1a and MurmurHash64A are combined into a 128 bit key.
+static uint64_t fnv1a64(const std::string& data)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint64_t murmur64(const std::string& data, uint64_t seed)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    size_t len = data.size();
+    const unsigned char* p = (const unsigned char*)data.data();
+    uint64_t h = seed ^ (len * m);
+
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        uint64_t k = 0;
+        for (int i = 7; i >= 0; i--)
+            k = (k << 8) | p[i];
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (len)
+    {
+        for (int i = len - 1; i >= 0; i--)
+            h ^= (uint64_t)p[i] << (8 * i);
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+static std::string computeKey(llvm::Module* m)
+{
+    std::string data;
+    llvm::raw_string_ostream os(data);
+    llvm::WriteBitcodeToFile(m, os);
+    os << '\0' << global.ldc_version << ' ' << global.llvm_version
+       << '\0' << optimizerSettings() << ' ' << writesBitcodeObjects()
+       << '\0' << gTargetMachine->getTargetTriple()
+       << ' ' << gTargetMachine->getTargetCPU()
+       << ' ' << gTargetMachine->getTargetFeatureString()
+       << ' ' << (int)gTargetMachine->getRelocationModel()
+       << ' ' << (int)gTargetMachine->getCodeModel()
+       << '\0' << (int)global.params.symdebug
+       << ' ' << llvm::NoFramePointerElim;
+    os.flush();
+
+    char buf[33];
+    sprintf(buf, "%016llx%016llx", (unsigned long long)fnv1a64(data),
+            (unsigned long long)murmur64(data, 0x4c4443));
+    return buf;
+}
+
+#if POSIX
+
+static bool copyFile(const std::string& from, const std::string& to)
+{
+    int in = open(from.c_str(), O_RDONLY);
+    if (in < 0)
+        return false;
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0)
+    {
+        close(in);
+        return false;
+    }
+
+    char buf[65536];
+    bool ok = true;
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) > 0)
+    {
+        if (write(out, buf, n) != n)
+        {
+            ok = false;
+            break;
+        }
+    }
+    if (n < 0)
+        ok = false;
+    close(in);
+    if (close(out) != 0)
+        ok = false;
+    if (!ok)
+        unlink(to.c_str());
+    return ok;
+}
+
+static void listCacheFiles(const std::string& dir, std::vector<CacheFile>& files)
+{
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (struct dirent* entry = readdir(d))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        std::string path = dir + "/" + entry->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            listCacheFiles(path, files);
+        else
+        {
+            CacheFile f;
+            f.path = path;
+            f.mtime = st.st_mtime;
+            f.size = st.st_size;
+            files.push_back(f);
+        }
+    }
+    closedir(d);
+}
+
+static void evictEntries()
+{
+    std::vector<CacheFile> files;
+    listCacheFiles(cacheDir, files);
+
+    unsigned long long total = 0;
+    for (size_t i = 0; i < files.size(); i++)
+        total += files[i].size;
+
+    unsigned long long limit = (unsigned long long)cacheSize << 20;
+    if (total <= limit)
+        return;
+
+    // oldest first
+    std::sort(files.begin(), files.end());
+    for (size_t i = 0; i < files.size() && total > limit; i++)
+    {
+        Logger::println("Evicting %s from the object cache", files[i].path.c_str());
+        if (unlink(files[i].path.c_str()) == 0)
+        {
+            total -= files[i].size;
+            cacheEvictions++;
+        }
+    }
+}
+
+#endif // POSIX
+
+//////////////////////////////////////////////////////////////////////////////
+
+bool objCacheFetch(llvm::Module* m, const std::string& objfile)
+{
+#if POSIX
+    // only plain object files are cached
+    if (cacheDir.empty() || !global.params.output_o || global.params.output_bc
+        || global.params.output_ll || global.params.output_s)
+        return false;
+
+    std::string key = computeKey(m);
+    std::string subdir = cacheDir + "/" + key.substr(0, 2);
+    std::string path = subdir + "/" + key.substr(2) + "." + global.obj_ext;
+
+    if (access(path.c_str(), R_OK) == 0)
+    {
+        unlink(objfile.c_str());
+        if (link(path.c_str(), objfile.c_str()) == 0 || copyFile(path, objfile))
+        {
+            Logger::println("Object cache hit for %s: %s", objfile.c_str(), key.c_str());
+            // keep the entry alive for LRU eviction
+            utime(path.c_str(), NULL);
+            cacheHits++;
+            return true;
+        }
+    }
+
+    Logger::println("Object cache miss for %s: %s", objfile.c_str(), key.c_str());
+    cacheMisses++;
+
+    // The object file may still be a hard link to the entry of an older
+    // key; break the link before the backend writes the new object.
+    unlink(objfile.c_str());
+
+    bool existing;
+    if (llvm::sys::fs::create_directories(subdir, existing))
+    {
+        warning("cannot create object cache directory '%s'", subdir.c_str());
+        return false;
+    }
+
+    PendingEntry entry;
+    entry.path = path;
+    entry.objfile = objfile;
+    pendingEntries.push_back(entry);
+#endif
+    return false;
+}
+
+void objCacheCommit()
+{
+#if POSIX
+    if (cacheDir.empty())
+        return;
+
+    if (!global.errors)
+    {
+        for (size_t i = 0; i < pendingEntries.size(); i++)
+        {
+            // Copy and then rename, so that concurrent compiler runs never
+            // see a partially written entry.
+            const PendingEntry& entry = pendingEntries[i];
+            char pid[32];
+            sprintf(pid, ".%d", (int)getpid());
+            std::string tmp = entry.path + pid;
+            // Entries are read-only, so that a write through a hard link
+            // fails instead of silently changing the cached object.
+            if (!copyFile(entry.objfile, tmp) || chmod(tmp.c_str(), 0444) != 0
+                || rename(tmp.c_str(), entry.path.c_str()) != 0)
+            {
+                unlink(tmp.c_str());
+                warning("cannot add '%s' to the object cache", entry.objfile.c_str());
+            }
+        }
+    }
+    pendingEntries.clear();
+
+    evictEntries();
+
+    if (global.params.verbose)
+        printf("cache     %u hits, %u misses, %u evicted\n", cacheHits, cacheMisses, cacheEvictions);
+#endif
+}
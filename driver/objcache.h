@@ -0,0 +1,29 @@
+#ifndef LDC_DRIVER_OBJCACHE_H
+#define LDC_DRIVER_OBJCACHE_H
+
+#include <string>
+
+namespace llvm
+{
+    class Module;
+}
+
+/**
+ * Looks up the object file for a module in the object cache (see -cache).
+ * The key is computed from the unoptimized bitcode of m, the optimizer
+ * settings and the target. On a miss, objfile is remembered so that it is
+ * added to the cache by objCacheCommit once it has been written.
+ * @param m Module as generated by the frontend, before optimization.
+ * @param objfile Object file name for m.
+ * @return true if objfile was restored from the cache.
+ */
+bool objCacheFetch(llvm::Module* m, const std::string& objfile);
+
+/**
+ * Adds all object files that missed to the cache, evicts the least recently
+ * used entries until the cache fits into -cache-size, and prints statistics
+ * if -v was given.
+ */
+void objCacheCommit();
+
+#endif // LDC_DRIVER_OBJCACHE_H
@@ -0,0 +1,277 @@
+#include "driver/partition.h"
+
+#include "llvm/Constants.h"
+#include "llvm/Function.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/Module.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include "gen/logger.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace {
+    // A definition and the global values it references.
+    struct Definition
+    {
+        GlobalValue* gv;
+        std::vector<GlobalValue*> refs;
+    };
+
+    // A set of definitions that has to end up in the same partition.
+    struct Cluster
+    {
+        std::vector<GlobalValue*> members;
+        unsigned size;
+        unsigned order;
+
+        bool operator<(const Cluster& other) const
+        {
+            if (size != other.size)
+                return size > other.size;
+            return order < other.order;
+        }
+    };
+
+    // Union-find over global values.
+    class Clusters
+    {
+        DenseMap<GlobalValue*, GlobalValue*> parent;
+
+    public:
+        GlobalValue* find(GlobalValue* gv)
+        {
+            GlobalValue* root = gv;
+            for (GlobalValue* p = parent.lookup(root); p; p = parent.lookup(root))
+                root = p;
+            // path compression
+            while (gv != root)
+            {
+                GlobalValue* next = parent[gv];
+                parent[gv] = root;
+                gv = next;
+            }
+            return root;
+        }
+
+        void join(GlobalValue* a, GlobalValue* b)
+        {
+            a = find(a);
+            b = find(b);
+            if (a != b)
+                parent[b] = a;
+        }
+    };
+}
+
+static void collectRefs(Value* v, SmallPtrSet<Constant*, 16>& visited,
+                        std::vector<GlobalValue*>& refs)
+{
+    if (GlobalValue* gv = dyn_cast<GlobalValue>(v))
+    {
+        refs.push_back(gv);
+        return;
+    }
+    Constant* c = dyn_cast<Constant>(v);
+    if (!c || !visited.insert(c))
+        return;
+    for (User::op_iterator I = c->op_begin(), E = c->op_end(); I != E; ++I)
+        collectRefs(*I, visited, refs);
+}
+
+static unsigned instructionCount(Function* f)
+{
+    unsigned count = 0;
+    for (Function::iterator BB = f->begin(), BE = f->end(); BB != BE; ++BB)
+        count += BB->size();
+    return count;
+}
+
+// Definitions that are emitted into every partition or only the first one
+// and thus are not subject to clustering.
+static bool isPinned(GlobalValue* gv)
+{
+    return gv->hasAppendingLinkage() || gv->hasAvailableExternallyLinkage();
+}
+
+std::vector<llvm::Module*> partitionModule(llvm::Module* m, unsigned n,
+                                           const std::string& uniqueName)
+{
+    std::vector<Module*> partitions;
+    if (n < 2 || !m->alias_empty())
+        return partitions;
+
+    Logger::println("Partitioning module '%s' into %u parts", m->getModuleIdentifier().c_str(), n);
+    LOG_SCOPE;
+
+    // collect all definitions and what they reference
+    std::vector<Definition> defs;
+    for (Module::iterator I = m->begin(), E = m->end(); I != E; ++I)
+    {
+        if (I->isDeclaration())
+            continue;
+        Definition def;
+        def.gv = I;
+        SmallPtrSet<Constant*, 16> visited;
+        for (Function::iterator BB = I->begin(), BE = I->end(); BB != BE; ++BB)
+            for (BasicBlock::iterator II = BB->begin(), IE = BB->end(); II != IE; ++II)
+                for (User::op_iterator OI = II->op_begin(), OE = II->op_end(); OI != OE; ++OI)
+                    collectRefs(*OI, visited, def.refs);
+        defs.push_back(def);
+    }
+    for (Module::global_iterator I = m->global_begin(), E = m->global_end(); I != E; ++I)
+    {
+        if (I->isDeclaration())
+            continue;
+        Definition def;
+        def.gv = I;
+        SmallPtrSet<Constant*, 16> visited;
+        collectRefs(I->getInitializer(), visited, def.refs);
+        defs.push_back(def);
+    }
+
+    // Keep internal functions with their callers, and place every global
+    // variable next to the first function that references it.
+    Clusters clusters;
+    SmallPtrSet<GlobalValue*, 64> placedVars;
+    for (size_t i = 0; i < defs.size(); i++)
+    {
+        Definition& def = defs[i];
+        if (isPinned(def.gv))
+            continue;
+        for (size_t j = 0; j < def.refs.size(); j++)
+        {
+            GlobalValue* ref = def.refs[j];
+            if (ref->isDeclaration() || isPinned(ref))
+                continue;
+            if (isa<Function>(ref))
+            {
+                if (ref->hasLocalLinkage())
+                    clusters.join(def.gv, ref);
+            }
+            else if (isa<Function>(def.gv) && placedVars.insert(ref))
+            {
+                clusters.join(def.gv, ref);
+            }
+        }
+    }
+
+    // gather the clusters in module order
+    DenseMap<GlobalValue*, unsigned> clusterIndex;
+    std::vector<Cluster> clusterList;
+    for (size_t i = 0; i < defs.size(); i++)
+    {
+        GlobalValue* gv = defs[i].gv;
+        if (isPinned(gv))
+            continue;
+        GlobalValue* root = clusters.find(gv);
+        DenseMap<GlobalValue*, unsigned>::iterator it = clusterIndex.find(root);
+        unsigned idx;
+        if (it == clusterIndex.end())
+        {
+            idx = clusterList.size();
+            clusterIndex[root] = idx;
+            Cluster c;
+            c.size = 0;
+            c.order = idx;
+            clusterList.push_back(c);
+        }
+        else
+            idx = it->second;
+
+        Cluster& c = clusterList[idx];
+        c.members.push_back(gv);
+        if (Function* f = dyn_cast<Function>(gv))
+            c.size += instructionCount(f);
+        else
+            c.size += 1;
+    }
+
+    if (clusterList.size() < 2)
+        return partitions;
+    if (n > clusterList.size())
+        n = clusterList.size();
+
+    // largest clusters first, each into the least loaded partition
+    std::sort(clusterList.begin(), clusterList.end());
+    std::vector<unsigned> load(n, 0);
+    DenseMap<GlobalValue*, unsigned> partitionOf;
+    for (size_t i = 0; i < clusterList.size(); i++)
+    {
+        unsigned p = std::min_element(load.begin(), load.end()) - load.begin();
+        load[p] += clusterList[i].size;
+        for (size_t j = 0; j < clusterList[i].members.size(); j++)
+            partitionOf[clusterList[i].members[j]] = p;
+    }
+    // appending globals (llvm.global_ctors, llvm.used, ...) go to the first
+    // partition
+    for (size_t i = 0; i < defs.size(); i++)
+        if (defs[i].gv->hasAppendingLinkage())
+            partitionOf[defs[i].gv] = 0;
+
+    // externalize internal symbols that are referenced across partitions
+    unsigned renamed = 0;
+    for (size_t i = 0; i < defs.size(); i++)
+    {
+        Definition& def = defs[i];
+        if (def.gv->hasAvailableExternallyLinkage())
+            continue;
+        unsigned p = partitionOf[def.gv];
+        for (size_t j = 0; j < def.refs.size(); j++)
+        {
+            GlobalValue* ref = def.refs[j];
+            if (!ref->hasLocalLinkage() || isPinned(ref) || partitionOf[ref] == p)
+                continue;
+            std::string name;
+            raw_string_ostream os(name);
+            os << uniqueName << ".part." << renamed++;
+            if (ref->hasName())
+                os << '.' << ref->getName();
+            ref->setName(os.str());
+            ref->setLinkage(GlobalValue::ExternalLinkage);
+            ref->setVisibility(GlobalValue::HiddenVisibility);
+        }
+    }
+    Logger::println("Externalized %u internal symbols", renamed);
+
+    // create the partitions, each with the foreign definitions stripped
+    for (unsigned p = 0; p < n; p++)
+    {
+        ValueToValueMapTy vmap;
+        Module* part = CloneModule(m, vmap);
+
+        for (Module::iterator I = m->begin(), E = m->end(); I != E; ++I)
+        {
+            if (I->isDeclaration() || isPinned(I) || partitionOf[I] == p)
+                continue;
+            // resets the linkage to external as well
+            Value* f = vmap[I];
+            cast<Function>(f)->deleteBody();
+        }
+        for (Module::global_iterator I = m->global_begin(), E = m->global_end(); I != E; ++I)
+        {
+            if (I->isDeclaration() || I->hasAvailableExternallyLinkage() || partitionOf[I] == p)
+                continue;
+            Value* v = vmap[I];
+            GlobalVariable* gv = cast<GlobalVariable>(v);
+            if (I->hasAppendingLinkage())
+            {
+                gv->eraseFromParent();
+                continue;
+            }
+            gv->setInitializer(NULL);
+            gv->setLinkage(GlobalValue::ExternalLinkage);
+        }
+
+        Logger::println("Partition %u: %u instructions", p, load[p]);
+        partitions.push_back(part);
+    }
+
+    return partitions;
+}
@@ -0,0 +1,28 @@
+#ifndef LDC_DRIVER_PARTITION_H
+#define LDC_DRIVER_PARTITION_H
+
+#include <string>
+#include <vector>
+
+namespace llvm
+{
+    class Module;
+}
+
+/**
+ * Splits an already optimized module into at most n partitions for parallel
+ * code generation. Functions are grouped with the internal functions they
+ * call and with the globals they are the first to reference; the groups are
+ * then spread over the partitions by instruction count.
+ * Internal symbols that end up referenced from more than one partition are
+ * made hidden and renamed using uniqueName as prefix.
+ * @param m Module to split. It is modified, but stays owned by the caller.
+ * @param n Maximum number of partitions.
+ * @param uniqueName Prefix for the names of externalized internal symbols.
+ * @return The partitions, which the caller owns, or an empty vector if the
+ *         module could not be split.
+ */
+std::vector<llvm::Module*> partitionModule(llvm::Module* m, unsigned n,
+                                           const std::string& uniqueName);
+
+#endif // LDC_DRIVER_PARTITION_H
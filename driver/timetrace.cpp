@@ -0,0 +1,288 @@
+#include "driver/timetrace.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/TimeValue.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "root.h"
+#include "mars.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if POSIX
+#include <pthread.h>
+#include <sys/resource.h>
+#endif
+
+static llvm::cl::opt<bool, true> timeTrace("ftime-trace",
+    llvm::cl::desc("Record the time spent in each compilation phase, template instantiation, "
+                   "CTFE call and function, and write it as Chrome trace-event JSON"),
+    llvm::cl::location(timeTraceEnabled));
+
+static llvm::cl::opt<std::string> timeTraceFile("ftime-trace-file",
+    llvm::cl::desc("Write the -ftime-trace output to <file>"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<unsigned> timeTraceGranularity("ftime-trace-granularity",
+    llvm::cl::desc("Minimum duration of the events recorded by -ftime-trace, in microseconds"),
+    llvm::cl::value_desc("us"),
+    llvm::cl::init(500));
+
+static llvm::cl::opt<unsigned> timeTraceTop("ftime-trace-top",
+    llvm::cl::desc("Number of the most expensive template instantiations, CTFE calls and "
+                   "functions listed in the -ftime-trace summary"),
+    llvm::cl::value_desc("n"),
+    llvm::cl::init(10));
+
+bool timeTraceEnabled = false;
+
+//////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    struct TraceEvent
+    {
+        const char* name;
+        std::string detail;
+        bool phase;
+        unsigned tid;
+        uint64_t start;     // microseconds
+        uint64_t duration;  // microseconds
+        uint64_t cpu;       // microseconds, only for phases
+        uint64_t peakMem;   // kilobytes, only for phases
+
+        bool operator<(const TraceEvent& other) const
+        {
+            return duration > other.duration;
+        }
+    };
+
+    struct PhaseSummary
+    {
+        const char* name;
+        uint64_t wall;
+        uint64_t cpu;
+        uint64_t peakMem;
+    };
+}
+
+static llvm::sys::SmartMutex<true> traceMutex;
+static std::vector<TraceEvent> traceEvents;
+static uint64_t traceStart = 0;
+#if POSIX
+static std::vector<pthread_t> traceThreads;
+#endif
+
+static uint64_t wallTime()
+{
+    llvm::sys::TimeValue now = llvm::sys::TimeValue::now();
+    return now.seconds() * 1000000 + now.microseconds();
+}
+
+static uint64_t cpuTime()
+{
+    llvm::sys::TimeValue elapsed(0, 0), user(0, 0), sys(0, 0);
+    llvm::sys::Process::GetTimeUsage(elapsed, user, sys);
+    return (user.seconds() + sys.seconds()) * 1000000 + user.microseconds() + sys.microseconds();
+}
+
+// Returns the peak resident set size of the process in kilobytes.
+static uint64_t peakMemory()
+{
+#if POSIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return llvm::sys::Process::GetMallocUsage() / 1024;
+#endif
+}
+
+// Returns a small number identifying the current thread; must be called with
+// traceMutex held.
+static unsigned currentThread()
+{
+#if POSIX
+    pthread_t self = pthread_self();
+    for (size_t i = 0; i < traceThreads.size(); i++)
+        if (pthread_equal(traceThreads[i], self))
+            return i;
+    traceThreads.push_back(self);
+    return traceThreads.size() - 1;
+#else
+    return 0;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+TimeTraceScope::TimeTraceScope(const char* name, const char* detail, bool phase)
+: name(name), detail(detail), phase(phase), start(0), startCpu(0)
+{
+    if (!timeTraceEnabled || !name)
+        return;
+    start = wallTime();
+    if (phase)
+        startCpu = cpuTime();
+}
+
+TimeTraceScope::~TimeTraceScope()
+{
+    if (!timeTraceEnabled || !start)
+        return;
+
+    uint64_t duration = wallTime() - start;
+    if (!phase && duration < timeTraceGranularity)
+        return;
+
+    TraceEvent e;
+    e.name = name;
+    if (detail)
+        e.detail = detail;
+    e.phase = phase;
+    e.start = start;
+    e.duration = duration;
+    e.cpu = phase ? cpuTime() - startCpu : 0;
+    e.peakMem = phase ? peakMemory() : 0;
+
+    llvm::sys::SmartScopedLock<true> lock(traceMutex);
+    if (!traceStart || start < traceStart)
+        traceStart = start;
+    e.tid = currentThread();
+    traceEvents.push_back(e);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void writeJSONString(llvm::raw_ostream& os, const std::string& str)
+{
+    os << '"';
+    for (size_t i = 0; i < str.size(); i++)
+    {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\')
+            os << '\\' << c;
+        else if (c < 0x20)
+        {
+            char buf[8];
+            sprintf(buf, "\\u%04x", c);
+            os << buf;
+        }
+        else
+            os << c;
+    }
+    os << '"';
+}
+
+static void writeChromeTrace(const char* filename)
+{
+    std::string errinfo;
+    llvm::raw_fd_ostream os(filename, errinfo);
+    if (!errinfo.empty())
+    {
+        error("cannot write time trace '%s': %s", filename, errinfo.c_str());
+        return;
+    }
+
+    os << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < traceEvents.size(); i++)
+    {
+        const TraceEvent& e = traceEvents[i];
+        os << "{\"pid\":1,\"tid\":" << e.tid << ",\"ph\":\"X\",\"cat\":\""
+           << (e.phase ? "phase" : "detail") << "\",\"name\":";
+        writeJSONString(os, e.name);
+        os << ",\"ts\":" << (e.start - traceStart) << ",\"dur\":" << e.duration;
+        if (!e.detail.empty() || e.phase)
+        {
+            os << ",\"args\":{";
+            if (!e.detail.empty())
+            {
+                os << "\"detail\":";
+                writeJSONString(os, e.detail);
+            }
+            if (e.phase)
+            {
+                if (!e.detail.empty())
+                    os << ',';
+                os << "\"cpu us\":" << e.cpu << ",\"peak rss kb\":" << e.peakMem;
+            }
+            os << '}';
+        }
+        os << "},\n";
+    }
+    os << "{\"pid\":1,\"tid\":0,\"ph\":\"M\",\"name\":\"process_name\","
+          "\"args\":{\"name\":\"ldc\"}}\n";
+    os << "]}\n";
+}
+
+static void printTop(const char* name, const char* title)
+{
+    std::vector<TraceEvent> top;
+    for (size_t i = 0; i < traceEvents.size(); i++)
+        if (!traceEvents[i].phase && !strcmp(traceEvents[i].name, name))
+            top.push_back(traceEvents[i]);
+    if (top.empty())
+        return;
+
+    size_t n = std::min<size_t>(top.size(), timeTraceTop);
+    std::partial_sort(top.begin(), top.begin() + n, top.end());
+
+    printf("\nslowest %s:\n", title);
+    for (size_t i = 0; i < n; i++)
+        printf("%10.2f ms  %s\n", top[i].duration / 1000.0, top[i].detail.c_str());
+}
+
+void timeTraceFinish(const char* defaultFile)
+{
+    if (!timeTraceEnabled)
+        return;
+
+    llvm::sys::SmartScopedLock<true> lock(traceMutex);
+
+    std::string filename = timeTraceFile;
+    if (filename.empty())
+        filename = defaultFile;
+    writeChromeTrace(filename.c_str());
+
+    // Sum up the phases in the order they were first entered.
+    std::vector<PhaseSummary> phases;
+    for (size_t i = 0; i < traceEvents.size(); i++)
+    {
+        const TraceEvent& e = traceEvents[i];
+        if (!e.phase)
+            continue;
+        size_t j = 0;
+        while (j < phases.size() && strcmp(phases[j].name, e.name))
+            j++;
+        if (j == phases.size())
+        {
+            PhaseSummary p = { e.name, 0, 0, 0 };
+            phases.push_back(p);
+        }
+        phases[j].wall += e.duration;
+        phases[j].cpu += e.cpu;
+        phases[j].peakMem = std::max(phases[j].peakMem, e.peakMem);
+    }
+
+    printf("time trace written to %s\n\n", filename.c_str());
+    printf("%-12s %12s %12s %12s\n", "phase", "wall ms", "cpu ms", "peak MB");
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+        printf("%-12s %12.2f %12.2f %12.1f\n", phases[i].name,
+            phases[i].wall / 1000.0, phases[i].cpu / 1000.0, phases[i].peakMem / 1024.0);
+    }
+
+    printTop("Template", "template instantiations");
+    printTop("CTFE", "CTFE calls");
+    printTop("Codegen function", "functions in codegen");
+}
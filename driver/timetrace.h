@@ -0,0 +1,43 @@
+#ifndef LDC_DRIVER_TIMETRACE_H
+#define LDC_DRIVER_TIMETRACE_H
+
+#include <stdint.h>
+
+/// True if -ftime-trace was given.
+extern bool timeTraceEnabled;
+
+/**
+ * Writes the recorded events as Chrome trace-event JSON to the file given by
+ * -ftime-trace-file (or defaultFile), and prints a summary of the phases and
+ * of the most expensive template instantiations, CTFE calls and functions.
+ * Does nothing unless -ftime-trace was given.
+ * @param defaultFile Trace file name to use if -ftime-trace-file is not set.
+ */
+void timeTraceFinish(const char* defaultFile);
+
+/**
+ * Records the time spent from its construction to its destruction, if
+ * -ftime-trace was given.
+ */
+class TimeTraceScope
+{
+public:
+    /**
+     * @param name Kind of work, e.g. "Semantic3" or "Template"; must be a
+     *             string literal. If NULL, nothing is recorded.
+     * @param detail What is worked on, e.g. a module name; may be NULL.
+     * @param phase True for the compilation phases, which are listed in the
+     *              summary along with their CPU time and peak memory usage.
+     */
+    TimeTraceScope(const char* name, const char* detail = 0, bool phase = false);
+    ~TimeTraceScope();
+
+private:
+    const char* name;
+    const char* detail;
+    bool phase;
+    uint64_t start;
+    uint64_t startCpu;
+};
+
+#endif // LDC_DRIVER_TIMETRACE_H
@@ -10,45 +10,82 @@
 #include <cstddef>
 #include <fstream>
 
+#include <deque>
+#include <vector>
+
 #include "llvm/Analysis/Verifier.h"
 #include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/LLVMContext.h"
 #include "llvm/Module.h"
 #include "llvm/PassManager.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 
+#if POSIX
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #include "gen/irstate.h"
 #include "gen/logger.h"
 #include "gen/optimizer.h"
 
+#include "driver/cl_options.h"
+#include "driver/partition.h"
+#include "driver/timetrace.h"
+#include "driver/toobj.h"
 
-// fwd decl
-void emit_file(llvm::TargetMachine &Target, llvm::Module& m, llvm::raw_fd_ostream& Out,
-               llvm::TargetMachine::CodeGenFileType fileType);
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
 void writeModule(llvm::Module* m, std::string filename)
+{
+    writeModule(*gTargetMachine, m, filename);
+}
+
+bool writesBitcodeObjects()
+{
+    // Code generation is deferred to the link step, except for static
+    // libraries, which are archived with the system ar and read by the
+    // system linker.
+    return linkTimeOptimization() && !opts::createStaticLib;
+}
+
+// The backend threads must neither report errors nor exit, so failures are
+// returned in err.
+static bool optimizeModule(llvm::Module* m, std::string& err)
 {
     // run optimizer
     bool reverify = ldc_optimize_module(m);
 
     // verify the llvm
     if (!global.params.noVerify && reverify) {
-        std::string verifyErr;
         Logger::println("Verifying module... again...");
         LOG_SCOPE;
-        if (llvm::verifyModule(*m,llvm::ReturnStatusAction,&verifyErr))
-        {
-            error("%s", verifyErr.c_str());
-            fatal();
-        }
-        else {
-            Logger::println("Verification passed!");
-        }
+        if (llvm::verifyModule(*m,llvm::ReturnStatusAction,&err))
+            return false;
+        Logger::println("Verification passed!");
     }
+    return true;
+}
+
+static bool writeModuleFiles(llvm::TargetMachine& target, llvm::Module* m, std::string filename,
+                             bool runOptimizer, std::string& err)
+{
+    if (runOptimizer) {
+        TimeTraceScope timeScope("Optimize", filename.c_str());
+        if (!optimizeModule(m, err))
+            return false;
+    }
+
+    TimeTraceScope timeScope("Emit", filename.c_str());
 
     // eventually do our own path stuff, dmd's is a bit strange.
     typedef llvm::sys::Path LLPath;
@@ -61,10 +98,10 @@ void writeModule(llvm::Module* m, std::string filename)
         Logger::println("Writing LLVM bitcode to: %s\n", bcpath.c_str());
         std::string errinfo;
         llvm::raw_fd_ostream bos(bcpath.c_str(), errinfo, llvm::raw_fd_ostream::F_Binary);
-        if (bos.has_error())
+        if (!errinfo.empty())
         {
-            error("cannot write LLVM bitcode file '%s': %s", bcpath.c_str(), errinfo.c_str());
-            fatal();
+            err = "cannot write LLVM bitcode file '" + bcpath.str() + "': " + errinfo;
+            return false;
         }
         llvm::WriteBitcodeToFile(m, bos);
     }
@@ -77,10 +114,10 @@ void writeModule(llvm::Module* m, std::string filename)
         Logger::println("Writing LLVM asm to: %s\n", llpath.c_str());
         std::string errinfo;
         llvm::raw_fd_ostream aos(llpath.c_str(), errinfo);
-        if (aos.has_error())
+        if (!errinfo.empty())
         {
-            error("cannot write LLVM asm file '%s': %s", llpath.c_str(), errinfo.c_str());
-            fatal();
+            err = "cannot write LLVM asm file '" + llpath.str() + "': " + errinfo;
+            return false;
         }
         m->print(aos, NULL);
     }
@@ -91,38 +128,285 @@ void writeModule(llvm::Module* m, std::string filename)
         spath.eraseSuffix();
         spath.appendSuffix(std::string(global.s_ext));
         Logger::println("Writing native asm to: %s\n", spath.c_str());
-        std::string err;
+        std::string errinfo;
         {
-            llvm::raw_fd_ostream out(spath.c_str(), err);
-            if (err.empty())
-            {
-                emit_file(*gTargetMachine, *m, out, llvm::TargetMachine::CGFT_AssemblyFile);
-            }
-            else
+            llvm::raw_fd_ostream out(spath.c_str(), errinfo);
+            if (!errinfo.empty())
             {
-                error("cannot write native asm: %s", err.c_str());
-                fatal();
+                err = "cannot write native asm: " + errinfo;
+                return false;
             }
+            emit_file(target, *m, out, llvm::TargetMachine::CGFT_AssemblyFile);
         }
     }
 
     if (global.params.output_o) {
         LLPath objpath = LLPath(filename);
         Logger::println("Writing object file to: %s\n", objpath.c_str());
-        std::string err;
+        // The object file may be a hard link to an object cache entry, so
+        // never write it in place; write a temporary and rename it over.
+        std::string tmppath = filename + ".tmp";
+        std::string errinfo;
         {
-            llvm::raw_fd_ostream out(objpath.c_str(), err, llvm::raw_fd_ostream::F_Binary);
-            if (err.empty())
+            llvm::raw_fd_ostream out(tmppath.c_str(), errinfo, llvm::raw_fd_ostream::F_Binary);
+            if (!errinfo.empty())
             {
-                emit_file(*gTargetMachine, *m, out, llvm::TargetMachine::CGFT_ObjectFile);
+                err = "cannot write object file: " + errinfo;
+                return false;
             }
+            if (writesBitcodeObjects())
+                llvm::WriteBitcodeToFile(m, out);
             else
-            {
-                error("cannot write object file: %s", err.c_str());
-                fatal();
-            }
+                emit_file(target, *m, out, llvm::TargetMachine::CGFT_ObjectFile);
+        }
+        if (llvm::error_code ec = llvm::sys::fs::rename(tmppath, filename))
+        {
+            bool existed;
+            llvm::sys::fs::remove(tmppath, existed);
+            err = "cannot write object file '" + filename + "': " + ec.message();
+            return false;
+        }
+    }
+    return true;
+}
+
+void writeModule(llvm::TargetMachine& target, llvm::Module* m, std::string filename,
+                 bool runOptimizer)
+{
+    std::string err;
+    if (!writeModuleFiles(target, m, filename, runOptimizer, err))
+    {
+        error("%s", err.c_str());
+        fatal();
+    }
+}
+
+/* ================================================================== */
+
+// Parallel backend (-j).
+//
+// IR generation stays on the main thread and uses the global context, since
+// the IrType caches hang off the frontend types. Finished modules are
+// serialized to bitcode and read back by a worker into a fresh LLVMContext,
+// which is the only way to move a module between contexts. The object file
+// names are fixed by the caller, so the output does not depend on the order
+// in which the workers finish.
+
+#if POSIX
+
+namespace {
+    struct BackendJob
+    {
+        std::string bitcode;
+        std::string filename;
+        bool runOptimizer;
+        std::string error;      // set if the job failed
+    };
+
+    struct BackendQueue
+    {
+        pthread_mutex_t lock;
+        pthread_cond_t wakeup;
+        std::deque<BackendJob*> pending;
+        std::vector<BackendJob*> done;
+        std::vector<pthread_t> workers;
+        bool finished;
+    };
+}
+
+static BackendQueue* gBackendQueue = NULL;
+
+static void* backendWorker(void* arg)
+{
+    // TargetMachines are not safe to share, every worker owns one.
+    llvm::TargetMachine* target = static_cast<llvm::TargetMachine*>(arg);
+    BackendQueue& queue = *gBackendQueue;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue.lock);
+        while (queue.pending.empty() && !queue.finished)
+            pthread_cond_wait(&queue.wakeup, &queue.lock);
+        if (queue.pending.empty())
+        {
+            pthread_mutex_unlock(&queue.lock);
+            break;
+        }
+        BackendJob* job = queue.pending.front();
+        queue.pending.pop_front();
+        pthread_mutex_unlock(&queue.lock);
+
+        llvm::LLVMContext context;
+        llvm::MemoryBuffer* buffer = llvm::MemoryBuffer::getMemBuffer(
+            job->bitcode, job->filename, false);
+        std::string errinfo;
+        llvm::Module* m = llvm::ParseBitcodeFile(buffer, context, &errinfo);
+        delete buffer;
+        std::string().swap(job->bitcode);
+        if (!m)
+            job->error = "cannot read back module for '" + job->filename + "': " + errinfo;
+        else
+        {
+            writeModuleFiles(*target, m, job->filename, job->runOptimizer, job->error);
+            delete m;
+        }
+
+        // failures are reported by finishModuleWrites on the main thread
+        pthread_mutex_lock(&queue.lock);
+        queue.done.push_back(job);
+        pthread_mutex_unlock(&queue.lock);
+    }
+
+    delete target;
+    return NULL;
+}
+
+static unsigned backendThreadCount()
+{
+    if (opts::backendThreads != 0)
+        return opts::backendThreads;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncpus > 0 ? ncpus : 1;
+}
+
+static void startBackendWorkers(unsigned count)
+{
+    gBackendQueue = new BackendQueue;
+    pthread_mutex_init(&gBackendQueue->lock, NULL);
+    pthread_cond_init(&gBackendQueue->wakeup, NULL);
+    gBackendQueue->finished = false;
+
+    llvm::llvm_start_multithreaded();
+
+    const llvm::Target& theTarget = gTargetMachine->getTarget();
+    for (unsigned i = 0; i < count; i++)
+    {
+        llvm::TargetMachine* target = theTarget.createTargetMachine(
+            gTargetMachine->getTargetTriple(), gTargetMachine->getTargetCPU(),
+            gTargetMachine->getTargetFeatureString(),
+            gTargetMachine->getRelocationModel(), gTargetMachine->getCodeModel());
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, &backendWorker, target) != 0)
+        {
+            error("failed to start backend thread");
+            fatal();
+        }
+        gBackendQueue->workers.push_back(thread);
+    }
+}
+
+#endif // POSIX
+
+void writeModuleAsync(llvm::Module* m, std::string filename, bool runOptimizer)
+{
+#if POSIX
+    // The logger is not thread-safe, so -vv implies a serial backend.
+    unsigned count = backendThreadCount();
+    if (count > 1 && !Logger::enabled())
+    {
+        if (!gBackendQueue)
+            startBackendWorkers(count);
+
+        BackendJob* job = new BackendJob;
+        job->filename = filename;
+        job->runOptimizer = runOptimizer;
+        {
+            llvm::raw_string_ostream bos(job->bitcode);
+            llvm::WriteBitcodeToFile(m, bos);
+        }
+        delete m;
+
+        pthread_mutex_lock(&gBackendQueue->lock);
+        gBackendQueue->pending.push_back(job);
+        pthread_cond_signal(&gBackendQueue->wakeup);
+        pthread_mutex_unlock(&gBackendQueue->lock);
+        return;
+    }
+#endif
+
+    writeModule(*gTargetMachine, m, filename, runOptimizer);
+    delete m;
+}
+
+void finishModuleWrites()
+{
+#if POSIX
+    if (!gBackendQueue)
+        return;
+
+    pthread_mutex_lock(&gBackendQueue->lock);
+    gBackendQueue->finished = true;
+    pthread_cond_broadcast(&gBackendQueue->wakeup);
+    pthread_mutex_unlock(&gBackendQueue->lock);
+
+    for (size_t i = 0; i < gBackendQueue->workers.size(); i++)
+        pthread_join(gBackendQueue->workers[i], NULL);
+
+    bool failed = false;
+    for (size_t i = 0; i < gBackendQueue->done.size(); i++)
+    {
+        BackendJob* job = gBackendQueue->done[i];
+        if (!job->error.empty())
+        {
+            error("%s", job->error.c_str());
+            failed = true;
         }
+        delete job;
     }
+
+    pthread_cond_destroy(&gBackendQueue->wakeup);
+    pthread_mutex_destroy(&gBackendQueue->lock);
+    delete gBackendQueue;
+    gBackendQueue = NULL;
+
+    if (failed)
+        fatal();
+#endif
+}
+
+std::vector<std::string> writeModulePartitioned(llvm::Module* m, std::string filename,
+                                                unsigned n, const std::string& uniqueName)
+{
+    std::vector<std::string> objfiles;
+
+    // The IPO passes need to see the whole program, so optimize before
+    // splitting; only code generation is done per partition.
+    std::string err;
+    if (!optimizeModule(m, err))
+    {
+        error("%s", err.c_str());
+        fatal();
+    }
+
+    std::vector<llvm::Module*> partitions = partitionModule(m, n, uniqueName);
+    if (partitions.empty())
+    {
+        writeModule(*gTargetMachine, m, filename, false);
+        objfiles.push_back(filename);
+        return objfiles;
+    }
+
+    typedef llvm::sys::Path LLPath;
+    for (size_t i = 0; i < partitions.size(); i++)
+    {
+        std::string partname = filename;
+        if (i != 0)
+        {
+            LLPath partpath = LLPath(filename);
+            partpath.eraseSuffix();
+            std::string suffix = "part";
+            suffix += llvm::utostr(i);
+            partpath.appendSuffix(suffix);
+            partpath.appendSuffix(std::string(global.obj_ext));
+            partname = partpath.str();
+        }
+        writeModuleAsync(partitions[i], partname, false);
+        objfiles.push_back(partname);
+    }
+    finishModuleWrites();
+
+    return objfiles;
 }
 
 /* ================================================================== */
@@ -1,6 +1,48 @@
 #ifndef LDC_GEN_TOOBJ_H
 #define LDC_GEN_TOOBJ_H
 
+#include <string>
+#include <vector>
+
+#include "llvm/Target/TargetMachine.h"
+
+namespace llvm {
+    class Module;
+    class raw_fd_ostream;
+}
+
 void writeModule(llvm::Module* m, std::string filename);
+void writeModule(llvm::TargetMachine& target, llvm::Module* m, std::string filename,
+                 bool runOptimizer = true);
+
+/**
+ * Whether object files hold bitcode for link-time optimization (-O4/-O5)
+ * instead of native code.
+ */
+bool writesBitcodeObjects();
+
+void emit_file(llvm::TargetMachine &Target, llvm::Module& m, llvm::raw_fd_ostream& Out,
+               llvm::TargetMachine::CodeGenFileType fileType);
+
+/**
+ * Optimizes and writes the module on one of the backend worker threads
+ * (see -j), or right away if only one backend thread is used.
+ * Takes ownership of m.
+ */
+void writeModuleAsync(llvm::Module* m, std::string filename, bool runOptimizer = true);
+
+/**
+ * Waits until all modules passed to writeModuleAsync have been written.
+ */
+void finishModuleWrites();
+
+/**
+ * Optimizes m as a whole, then splits it into up to n partitions (see
+ * -singleobj-partitions) which are written on the backend threads.
+ * Partition 0 is written to filename, the others next to it.
+ * @return The object files written.
+ */
+std::vector<std::string> writeModulePartitioned(llvm::Module* m, std::string filename,
+                                                unsigned n, const std::string& uniqueName);
 
 #endif
@@ -1,7 +1,9 @@
 #include "gen/llvm.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "mtype.h"
 #include "module.h"
+#include "expression.h"
 #include "declaration.h"
 #include "aggregate.h"
 
@@ -12,6 +14,7 @@
 #include "gen/logger.h"
 #include "gen/irstate.h"
 #include "gen/dvalue.h"
+#include "gen/arrays.h"
 #include "ir/irmodule.h"
 
 #if DMDV2
@@ -35,6 +38,410 @@ static LLValue* to_keyti(DValue* key)
 
 /////////////////////////////////////////////////////////////////////////////////////
 
+#if DMDV2
+
+static llvm::cl::opt<bool> inlineAALookups("inline-aa-lookups",
+    llvm::cl::desc("Inline associative array lookups for integral, pointer and string keys"),
+    llvm::cl::init(true));
+
+// returns true if the hash of the key type's TypeInfo is replicated by DtoAAKeyHash
+static bool isInlineAAKey(Type* keytype)
+{
+    if (!inlineAALookups)
+        return false;
+
+    Type* t = keytype->toBasetype();
+    if (t->ty == Tpointer)
+        return true;
+    if (t->isTypeBasic() && t->isintegral())
+        return true;
+    // char[] and string use TypeInfo_Aa's hash, other arrays TypeInfo_Array's
+    if (t->ty == Tarray && !t->mod)
+    {
+        Type* next = t->nextOf();
+        return next->ty == Tchar && (!next->mod || next->mod == MODimmutable);
+    }
+    return false;
+}
+
+// computes the hash of key like TypeInfo.getHash does for its type
+// (rt/typeinfo/ti_*.d and TypeInfo_Pointer in object_.d)
+static LLValue* DtoAAKeyHash(Type* keytype, DValue* key)
+{
+    LLType* sizeTy = DtoSize_t();
+    Type* t = keytype->toBasetype();
+
+    if (t->ty == Tpointer)
+        return gIR->ir->CreatePtrToInt(key->getRVal(), sizeTy, "aa.hash");
+
+    if (t->ty == Tarray)
+    {
+        // foreach (char c; s) hash = hash * 11 + c;
+        LLValue* len = DtoArrayLen(key);
+        LLValue* ptr = DtoArrayPtr(key);
+
+        llvm::BasicBlock* oldend = gIR->scopeend();
+        llvm::BasicBlock* entrybb = gIR->scopebb();
+        llvm::BasicBlock* condbb = llvm::BasicBlock::Create(gIR->context(), "aa.hashcond", gIR->topfunc(), oldend);
+        llvm::BasicBlock* bodybb = llvm::BasicBlock::Create(gIR->context(), "aa.hashbody", gIR->topfunc(), oldend);
+        llvm::BasicBlock* endbb = llvm::BasicBlock::Create(gIR->context(), "aa.hashend", gIR->topfunc(), oldend);
+        gIR->ir->CreateBr(condbb);
+
+        gIR->scope() = IRScope(condbb, bodybb);
+        llvm::PHINode* index = gIR->ir->CreatePHI(sizeTy, 2, "aa.hashidx");
+        llvm::PHINode* hash = gIR->ir->CreatePHI(sizeTy, 2, "aa.hash");
+        index->addIncoming(DtoConstSize_t(0), entrybb);
+        hash->addIncoming(DtoConstSize_t(0), entrybb);
+        gIR->ir->CreateCondBr(gIR->ir->CreateICmpULT(index, len), bodybb, endbb);
+
+        gIR->scope() = IRScope(bodybb, endbb);
+        LLValue* c = DtoLoad(gIR->ir->CreateGEP(ptr, index));
+        c = gIR->ir->CreateZExt(c, sizeTy);
+        LLValue* newhash = gIR->ir->CreateAdd(gIR->ir->CreateMul(hash, DtoConstSize_t(11)), c);
+        LLValue* newindex = gIR->ir->CreateAdd(index, DtoConstSize_t(1));
+        index->addIncoming(newindex, bodybb);
+        hash->addIncoming(newhash, bodybb);
+        gIR->ir->CreateBr(condbb);
+
+        gIR->scope() = IRScope(endbb, oldend);
+        return hash;
+    }
+
+    LLValue* k = key->getRVal();
+    unsigned bits = k->getType()->getPrimitiveSizeInBits();
+    if (bits == 64)
+    {
+        // (u)long: *cast(uint*)p + (cast(uint*)p)[1]
+        LLType* int32Ty = LLType::getInt32Ty(gIR->context());
+        LLValue* lo = gIR->ir->CreateTrunc(k, int32Ty);
+        LLValue* hi = gIR->ir->CreateTrunc(gIR->ir->CreateLShr(k, 32), int32Ty);
+        return gIR->ir->CreateZExtOrBitCast(gIR->ir->CreateAdd(lo, hi), sizeTy, "aa.hash");
+    }
+    // byte and short are sign extended, int is hashed as uint
+    bool isSigned = bits < 32 && !t->isunsigned();
+    return gIR->ir->CreateIntCast(k, sizeTy, isSigned, "aa.hash");
+}
+
+// Emits the lookup of key in aaval (a pointer to druntime's BB, see runtime.cpp)
+// and returns a pointer to the value, as a void*. Branches to missbb if the key
+// is not found. Does not call into the runtime, so the AA is never rehashed.
+static LLValue* DtoInlineAALookup(Type* keytype, LLValue* aaval, DValue* key, llvm::BasicBlock* missbb)
+{
+    llvm::LLVMContext& context = gIR->context();
+    llvm::Function* func = gIR->topfunc();
+    llvm::BasicBlock* oldend = gIR->scopeend();
+    llvm::BasicBlock* bucketsbb = llvm::BasicBlock::Create(context, "aa.buckets", func, oldend);
+    llvm::BasicBlock* hashbb = llvm::BasicBlock::Create(context, "aa.hash", func, oldend);
+
+    LLValue* aa = DtoBitCast(aaval, getPtrToType(LLVM_D_GetAABucketsType()));
+    gIR->ir->CreateCondBr(gIR->ir->CreateIsNull(aa), missbb, bucketsbb);
+
+    // aaA*[] b
+    gIR->scope() = IRScope(bucketsbb, hashbb);
+    LLValue* buckets = DtoGEPi(aa, 0, 0);
+    LLValue* nbuckets = DtoLoad(DtoGEPi(buckets, 0, 0), "aa.nbuckets");
+    LLValue* bucketsptr = DtoLoad(DtoGEPi(buckets, 0, 1));
+    gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(nbuckets, DtoConstSize_t(0)), missbb, hashbb);
+
+    // start at b[hash % b.length]
+    gIR->scope() = IRScope(hashbb, oldend);
+    LLValue* hash = DtoAAKeyHash(keytype, key);
+    LLValue* first = DtoLoad(gIR->ir->CreateGEP(bucketsptr, gIR->ir->CreateURem(hash, nbuckets)));
+    llvm::BasicBlock* entrybb = gIR->scopebb();
+
+    llvm::BasicBlock* loopbb = llvm::BasicBlock::Create(context, "aa.node", func, oldend);
+    llvm::BasicBlock* hashcmpbb = llvm::BasicBlock::Create(context, "aa.hashcmp", func, oldend);
+    llvm::BasicBlock* keycmpbb = llvm::BasicBlock::Create(context, "aa.keycmp", func, oldend);
+    llvm::BasicBlock* nextbb = llvm::BasicBlock::Create(context, "aa.next", func, oldend);
+    llvm::BasicBlock* hitbb = llvm::BasicBlock::Create(context, "aa.hit", func, oldend);
+    gIR->ir->CreateBr(loopbb);
+
+    // walk the list of nodes
+    gIR->scope() = IRScope(loopbb, hashcmpbb);
+    llvm::PHINode* node = gIR->ir->CreatePHI(first->getType(), 2, "aa.node");
+    node->addIncoming(first, entrybb);
+    gIR->ir->CreateCondBr(gIR->ir->CreateIsNull(node), missbb, hashcmpbb);
+
+    gIR->scope() = IRScope(hashcmpbb, keycmpbb);
+    LLValue* nodehash = DtoLoad(DtoGEPi(node, 0, 1), "aa.nodehash");
+    gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(nodehash, hash), keycmpbb, nextbb);
+
+    // compare the key stored after the node header
+    gIR->scope() = IRScope(keycmpbb, nextbb);
+    LLValue* nodeptr = DtoBitCast(node, getVoidPtrType());
+    LLValue* nodekey = gIR->ir->CreateGEP(nodeptr, DtoConstSize_t(LLVM_D_GetAAKeyOffset()));
+    nodekey = DtoLoad(DtoBitCast(nodekey, getPtrToType(DtoType(keytype))), "aa.nodekey");
+    if (keytype->toBasetype()->ty == Tarray)
+    {
+        LLValue* len = DtoArrayLen(key);
+        LLValue* nodelen = gIR->ir->CreateExtractValue(nodekey, 0);
+        llvm::BasicBlock* memcmpbb = llvm::BasicBlock::Create(context, "aa.memcmp", func, nextbb);
+        gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(len, nodelen), memcmpbb, nextbb);
+
+        gIR->scope() = IRScope(memcmpbb, nextbb);
+        LLValue* cmp = DtoMemCmp(DtoArrayPtr(key), gIR->ir->CreateExtractValue(nodekey, 1), len);
+        gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(cmp, DtoConstInt(0)), hitbb, nextbb);
+    }
+    else
+    {
+        gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(key->getRVal(), nodekey), hitbb, nextbb);
+    }
+
+    gIR->scope() = IRScope(nextbb, hitbb);
+    node->addIncoming(DtoLoad(DtoGEPi(node, 0, 0), "aa.next"), nextbb);
+    gIR->ir->CreateBr(loopbb);
+
+    // the value follows the key
+    gIR->scope() = IRScope(hitbb, oldend);
+    return gIR->ir->CreateGEP(nodeptr, DtoConstSize_t(LLVM_D_GetAAValueOffset(keytype)), "aa.value");
+}
+
+// computes DtoAAKeyHash of a constant key at compile time, returns false if
+// the key isn't an integer or string constant
+static bool constAAKeyHash(Type* keytype, Expression* key, uint64_t& hash)
+{
+    Type* t = keytype->toBasetype();
+    unsigned sizeBits = getTypeBitSize(DtoSize_t());
+    uint64_t sizeMask = sizeBits == 64 ? ~0ULL : (1ULL << sizeBits) - 1;
+
+    if (t->ty == Tarray)
+    {
+        if (key->op != TOKstring || ((StringExp*)key)->sz != 1)
+            return false;
+        StringExp* se = (StringExp*)key;
+        uint64_t h = 0;
+        for (size_t i = 0; i < se->len; i++)
+            h = h * 11 + ((unsigned char*)se->string)[i];
+        hash = h & sizeMask;
+        return true;
+    }
+
+    if (t->ty == Tpointer || !key->isConst())
+        return false;
+
+    uint64_t v = key->toInteger();
+    unsigned bits = getTypeBitSize(DtoType(t));
+    if (bits == 64)
+    {
+        hash = (uint32_t)((uint32_t)v + (uint32_t)(v >> 32));
+    }
+    else
+    {
+        v &= (1ULL << bits) - 1;
+        if (bits < 32 && !t->isunsigned() && (v >> (bits - 1)))
+            v |= ~0ULL << bits;
+        hash = v & sizeMask;
+    }
+    return true;
+}
+
+static bool sameConstAAKey(Expression* a, Expression* b)
+{
+    if (a->op == TOKstring)
+    {
+        StringExp* sa = (StringExp*)a;
+        StringExp* sb = (StringExp*)b;
+        return sa->len == sb->len && memcmp(sa->string, sb->string, sa->len) == 0;
+    }
+    return a->toInteger() == b->toInteger();
+}
+
+// the bucket count _d_assocarrayliteralTX chooses (prime_list in rt/aaA.d)
+static size_t aaLiteralBuckets(size_t length)
+{
+    static const size_t primes[] = { 31, 97, 389, 1543, 6151, 24593, 98317, 393241, 1572869 };
+    const size_t n = sizeof(primes) / sizeof(primes[0]);
+    size_t i = 0;
+    while (i < n - 1 && length > primes[i])
+        i++;
+    return primes[i];
+}
+
+LLValue* DtoConstAALiteral(Type* aatype, Expressions* keys,
+    const std::vector<LLConstant*>& keysInits, const std::vector<LLConstant*>& valuesInits)
+{
+    Type* keytype = ((TypeAArray*)aatype->toBasetype())->index;
+    Type* valuetype = aatype->toBasetype()->nextOf();
+    size_t n = keys->dim;
+    if (n == 0 || !isInlineAAKey(keytype))
+        return NULL;
+
+    // all nodes must have the same layout
+    LLType* keyTy = keysInits[0]->getType();
+    LLType* valueTy = valuesInits[0]->getType();
+    if (getTypeAllocSize(keyTy) != getTypePaddedSize(DtoType(keytype)) ||
+        getTypeAllocSize(valueTy) != getTypePaddedSize(DtoType(valuetype)))
+        return NULL;
+    for (size_t i = 1; i < n; i++)
+        if (keysInits[i]->getType() != keyTy || valuesInits[i]->getType() != valueTy)
+            return NULL;
+
+    // hash the keys; leave duplicate keys to the runtime
+    std::vector<uint64_t> hashes(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        Expression* key = (Expression*)keys->data[i];
+        if (!constAAKeyHash(keytype, key, hashes[i]))
+            return NULL;
+        for (size_t j = 0; j < i; j++)
+            if (hashes[j] == hashes[i] && sameConstAAKey((Expression*)keys->data[j], key))
+                return NULL;
+    }
+
+    Logger::println("building the hash table of the literal at compile time");
+    LOG_SCOPE;
+
+    // node: aaA header, key padded to the value offset, value
+    LLStructType* headerTy = LLVM_D_GetAANodeType();
+    LLType* headerPtrTy = getPtrToType(headerTy);
+    size_t keyOffset = LLVM_D_GetAAKeyOffset();
+    size_t padding = LLVM_D_GetAAValueOffset(keytype) - keyOffset - getTypeAllocSize(keyTy);
+    LLArrayType* paddingTy = LLArrayType::get(LLType::getInt8Ty(gIR->context()), padding);
+    std::vector<LLType*> nodeTypes;
+    nodeTypes.push_back(headerTy);
+    nodeTypes.push_back(keyTy);
+    nodeTypes.push_back(paddingTy);
+    nodeTypes.push_back(valueTy);
+    LLStructType* nodeTy = LLStructType::get(gIR->context(), nodeTypes, true);
+    LLArrayType* nodesTy = LLArrayType::get(nodeTy, n);
+
+    size_t nbuckets = aaLiteralBuckets(n);
+    std::vector<size_t> bucket(n);
+    for (size_t i = 0; i < n; i++)
+        bucket[i] = hashes[i] % nbuckets;
+
+    LLStructType* bbTy = LLVM_D_GetAABucketsType();
+    LLConstant* keyti = DtoTypeInfoOf(keytype, false);
+    keyti = llvm::ConstantExpr::getBitCast(keyti, bbTy->getElementType(2));
+
+    // An immutable table can't change, so it is emitted with all links
+    // in place and used as is.
+    if (aatype->isImmutable())
+    {
+        LLGlobalVariable* nodes = new LLGlobalVariable(*gIR->module, nodesTy, false,
+            LLGlobalValue::InternalLinkage, NULL, ".aaNodes");
+
+        // the runtime appends nodes at the end of their bucket's list
+        std::vector<LLConstant*> heads(nbuckets, LLConstant::getNullValue(headerPtrTy));
+        std::vector<LLConstant*> nexts(n, LLConstant::getNullValue(headerPtrTy));
+        std::vector<size_t> tails(nbuckets, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            LLConstant* idxs[3] = { DtoConstUint(0), DtoConstUint(i), DtoConstUint(0) };
+            LLConstant* node = llvm::ConstantExpr::getGetElementPtr(nodes, idxs, true);
+            if (tails[bucket[i]] == n)
+                heads[bucket[i]] = node;
+            else
+                nexts[tails[bucket[i]]] = node;
+            tails[bucket[i]] = i;
+        }
+
+        std::vector<LLConstant*> nodeInits(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            LLConstant* header[2] = { nexts[i], LLConstantInt::get(DtoSize_t(), hashes[i]) };
+            LLConstant* fields[4] = {
+                LLConstantStruct::get(headerTy, header),
+                keysInits[i],
+                LLConstant::getNullValue(paddingTy),
+                valuesInits[i]
+            };
+            nodeInits[i] = LLConstantStruct::get(nodeTy, fields);
+        }
+        nodes->setInitializer(LLConstantArray::get(nodesTy, nodeInits));
+
+        LLArrayType* bucketsTy = LLArrayType::get(headerPtrTy, nbuckets);
+        LLGlobalVariable* buckets = new LLGlobalVariable(*gIR->module, bucketsTy, false,
+            LLGlobalValue::InternalLinkage, LLConstantArray::get(bucketsTy, heads), ".aaBuckets");
+
+        LLConstant* idxs[2] = { DtoConstUint(0), DtoConstUint(0) };
+        LLConstant* b[2] = {
+            DtoConstSize_t(nbuckets),
+            llvm::ConstantExpr::getGetElementPtr(buckets, idxs, true)
+        };
+        LLConstant* bb[3] = {
+            LLConstantStruct::get(llvm::cast<LLStructType>(bbTy->getElementType(0)), b),
+            DtoConstSize_t(n),
+            keyti
+        };
+        LLGlobalVariable* aa = new LLGlobalVariable(*gIR->module, bbTy, false,
+            LLGlobalValue::InternalLinkage, LLConstantStruct::get(bbTy, bb), ".aaLiteral");
+        return DtoBitCast(aa, getVoidPtrType());
+    }
+
+    // Otherwise each evaluation gets its own copy of the table: the nodes
+    // are copied from a template and linked into a new bucket array. The
+    // runtime frees and relinks the nodes, so each needs its own GC block.
+    std::vector<LLConstant*> nodeInits(n);
+    std::vector<LLConstant*> bucketInits(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        LLConstant* header[2] = {
+            LLConstant::getNullValue(headerPtrTy),
+            LLConstantInt::get(DtoSize_t(), hashes[i])
+        };
+        LLConstant* fields[4] = {
+            LLConstantStruct::get(headerTy, header),
+            keysInits[i],
+            LLConstant::getNullValue(paddingTy),
+            valuesInits[i]
+        };
+        nodeInits[i] = LLConstantStruct::get(nodeTy, fields);
+        bucketInits[i] = DtoConstSize_t(bucket[i]);
+    }
+    LLGlobalVariable* nodes = new LLGlobalVariable(*gIR->module, nodesTy, true,
+        LLGlobalValue::InternalLinkage, LLConstantArray::get(nodesTy, nodeInits), ".aaNodes");
+    nodes->setUnnamedAddr(true);
+    LLArrayType* bucketIdxTy = LLArrayType::get(DtoSize_t(), n);
+    LLGlobalVariable* bucketIdx = new LLGlobalVariable(*gIR->module, bucketIdxTy, true,
+        LLGlobalValue::InternalLinkage, LLConstantArray::get(bucketIdxTy, bucketInits), ".aaNodeBuckets");
+    bucketIdx->setUnnamedAddr(true);
+
+    // aaA*[] b = new aaA*[nbuckets]
+    LLValue* bucketsSize = DtoConstSize_t(nbuckets * getTypeAllocSize(headerPtrTy));
+    LLFunction* allocfn = LLVM_D_GetRuntimeFunction(gIR->module, "_d_allocmemory");
+    LLValue* buckets = gIR->CreateCallOrInvoke(allocfn, bucketsSize, ".aaBuckets").getInstruction();
+    DtoMemSetZero(buckets, bucketsSize);
+    buckets = DtoBitCast(buckets, getPtrToType(headerPtrTy));
+
+    // for (i = n; i-- > 0; ) link a copy of node i in front of its bucket's
+    // list, which leaves the lists in the order the runtime creates
+    llvm::BasicBlock* oldend = gIR->scopeend();
+    llvm::BasicBlock* entrybb = gIR->scopebb();
+    llvm::BasicBlock* loopbb = llvm::BasicBlock::Create(gIR->context(), "aaliteral.node", gIR->topfunc(), oldend);
+    llvm::BasicBlock* endbb = llvm::BasicBlock::Create(gIR->context(), "aaliteral.end", gIR->topfunc(), oldend);
+    gIR->ir->CreateBr(loopbb);
+
+    gIR->scope() = IRScope(loopbb, endbb);
+    llvm::PHINode* index = gIR->ir->CreatePHI(DtoSize_t(), 2, "aaliteral.index");
+    index->addIncoming(DtoConstSize_t(n), entrybb);
+    LLValue* i = gIR->ir->CreateSub(index, DtoConstSize_t(1));
+
+    LLValue* node = DtoGcMalloc(nodeTy, ".aaNode");
+    DtoMemCpy(node, DtoGEP(nodes, DtoConstSize_t(0), i), DtoConstSize_t(getTypeAllocSize(nodeTy)));
+    LLValue* slot = gIR->ir->CreateGEP(buckets, DtoLoad(DtoGEP(bucketIdx, DtoConstSize_t(0), i)));
+    LLValue* header = DtoGEPi(node, 0, 0);
+    DtoStore(DtoLoad(slot), DtoGEPi(header, 0, 0));
+    DtoStore(header, slot);
+
+    index->addIncoming(i, gIR->scopebb());
+    gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(i, DtoConstSize_t(0)), endbb, loopbb);
+
+    // new BB
+    gIR->scope() = IRScope(endbb, oldend);
+    LLValue* aa = DtoGcMalloc(bbTy, ".aaLiteral");
+    LLValue* b = DtoGEPi(aa, 0, 0);
+    DtoStore(DtoConstSize_t(nbuckets), DtoGEPi(b, 0, 0));
+    DtoStore(buckets, DtoGEPi(b, 0, 1));
+    DtoStore(DtoConstSize_t(n), DtoGEPi(aa, 0, 1));
+    DtoStore(keyti, DtoGEPi(aa, 0, 2));
+    return DtoBitCast(aa, getVoidPtrType());
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+
 DValue* DtoAAIndex(Loc& loc, Type* type, DValue* aa, DValue* key, bool lvalue)
 {
     // D1:
@@ -61,28 +468,68 @@ DValue* DtoAAIndex(Loc& loc, Type* type, DValue* aa, DValue* key, bool lvalue)
     LLValue* aaval = lvalue ? aa->getLVal() : aa->getRVal();
     aaval = DtoBitCast(aaval, funcTy->getParamType(0));
 
-    // keyti param
 #if DMDV2
-    LLValue* keyti = to_keyti(aa);
+    // inline the lookup if possible; then rvalues don't need the runtime at
+    // all, and lvalues only call it on a miss to insert the key
+    Type* keytype = ((TypeAArray*)aa->type->toBasetype())->index;
+    llvm::BasicBlock* oldend = gIR->scopeend();
+    llvm::BasicBlock* hitbb = NULL;
+    llvm::BasicBlock* endbb = NULL;
+    LLValue* hitval = NULL;
+    if (isInlineAAKey(keytype)) {
+        llvm::BasicBlock* missbb = llvm::BasicBlock::Create(gIR->context(), "aa.miss", gIR->topfunc(), oldend);
+        endbb = llvm::BasicBlock::Create(gIR->context(), "aa.lookupend", gIR->topfunc(), oldend);
+        // aaval is cast to the runtime's opaque AA type, look at the BB*
+        // itself
+        hitval = DtoInlineAALookup(keytype, aa->getRVal(), key, missbb);
+        hitbb = gIR->scopebb();
+        gIR->ir->CreateBr(endbb);
+        gIR->scope() = IRScope(missbb, endbb);
+    }
+#endif
+
+    LLValue* ret;
+#if DMDV2
+    if (hitval && !lvalue) {
+        ret = LLConstant::getNullValue(getVoidPtrType());
+    } else
+#endif
+    {
+        // keyti param
+#if DMDV2
+        LLValue* keyti = to_keyti(aa);
 #else
-    LLValue* keyti = to_keyti(key);
+        LLValue* keyti = to_keyti(key);
 #endif
-    keyti = DtoBitCast(keyti, funcTy->getParamType(1));
+        keyti = DtoBitCast(keyti, funcTy->getParamType(1));
 
-    // pkey param
-    LLValue* pkey = makeLValue(loc, key);
-    pkey = DtoBitCast(pkey, funcTy->getParamType(lvalue ? 3 : 2));
+        // pkey param
+        LLValue* pkey = makeLValue(loc, key);
+        pkey = DtoBitCast(pkey, funcTy->getParamType(lvalue ? 3 : 2));
 
-    // call runtime
-    LLValue* ret;
-    if (lvalue) {
-        // valuesize param
-        LLValue* valsize = DtoConstSize_t(getTypePaddedSize(DtoType(type)));
-        
-        ret = gIR->CreateCallOrInvoke4(func, aaval, keyti, valsize, pkey, "aa.index").getInstruction();
-    } else {
-        ret = gIR->CreateCallOrInvoke3(func, aaval, keyti, pkey, "aa.index").getInstruction();
+        // call runtime
+        if (lvalue) {
+            // valuesize param
+            LLValue* valsize = DtoConstSize_t(getTypePaddedSize(DtoType(type)));
+
+            ret = gIR->CreateCallOrInvoke4(func, aaval, keyti, valsize, pkey, "aa.index").getInstruction();
+        } else {
+            ret = gIR->CreateCallOrInvoke3(func, aaval, keyti, pkey, "aa.index").getInstruction();
+        }
+    }
+
+#if DMDV2
+    // merge the inline lookup and the miss
+    if (hitval) {
+        llvm::BasicBlock* missendbb = gIR->scopebb();
+        gIR->ir->CreateBr(endbb);
+        gIR->scope() = IRScope(endbb, oldend);
+        llvm::PHINode* phi = gIR->ir->CreatePHI(getVoidPtrType(), 2, "aa.index");
+        phi->addIncoming(hitval, hitbb);
+        phi->addIncoming(ret, missendbb);
+        ret = phi;
     }
+#endif
 
     // cast return value
     LLType* targettype = getPtrToType(DtoType(type));
@@ -93,12 +540,12 @@ DValue* DtoAAIndex(Loc& loc, Type* type, DValue* aa, DValue* key, bool lvalue)
     // Lvalue use ('aa[key] = value') auto-adds an element.
     if (!lvalue && global.params.useArrayBounds) {
         llvm::BasicBlock* oldend = gIR->scopeend();
-        llvm::BasicBlock* failbb = llvm::BasicBlock::Create(gIR->context(), "aaboundscheckfail", gIR->topfunc(), oldend);
+        llvm::BasicBlock* failbb = DtoCreateColdBlock("aaboundscheckfail");
         llvm::BasicBlock* okbb = llvm::BasicBlock::Create(gIR->context(), "aaboundsok", gIR->topfunc(), oldend);
 
         LLValue* nullaa = LLConstant::getNullValue(ret->getType());
         LLValue* cond = gIR->ir->CreateICmpNE(nullaa, ret, "aaboundscheck");
-        gIR->ir->CreateCondBr(cond, okbb, failbb);
+        DtoCondBrCold(cond, okbb, failbb);
 
         // set up failbb to call the array bounds error runtime function
 
@@ -166,6 +613,28 @@ DValue* DtoAAIn(Loc& loc, Type* type, DValue* aa, DValue* key)
     }
     aaval = DtoBitCast(aaval, funcTy->getParamType(0));
 
+#if DMDV2
+    // inline the lookup if possible, a miss yields null without calling the runtime
+    Type* keytype = ((TypeAArray*)aa->type->toBasetype())->index;
+    if (isInlineAAKey(keytype)) {
+        llvm::BasicBlock* oldend = gIR->scopeend();
+        llvm::BasicBlock* missbb = llvm::BasicBlock::Create(gIR->context(), "aa.miss", gIR->topfunc(), oldend);
+        llvm::BasicBlock* endbb = llvm::BasicBlock::Create(gIR->context(), "aa.lookupend", gIR->topfunc(), oldend);
+        LLValue* hitval = DtoInlineAALookup(keytype, aaval, key, missbb);
+        llvm::BasicBlock* hitbb = gIR->scopebb();
+        gIR->ir->CreateBr(endbb);
+
+        gIR->scope() = IRScope(missbb, endbb);
+        gIR->ir->CreateBr(endbb);
+
+        gIR->scope() = IRScope(endbb, oldend);
+        llvm::PHINode* phi = gIR->ir->CreatePHI(getVoidPtrType(), 2, "aa.in");
+        phi->addIncoming(hitval, hitbb);
+        phi->addIncoming(LLConstant::getNullValue(getVoidPtrType()), missbb);
+        return new DImValue(type, DtoBitCast(phi, DtoType(type)));
+    }
+#endif
+
     // keyti param
 #if DMDV2
     LLValue* keyti = to_keyti(aa);
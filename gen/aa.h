@@ -5,5 +5,9 @@ DValue* DtoAAIndex(Loc& loc, Type* type, DValue* aa, DValue* key, bool lvalue);
 DValue* DtoAAIn(Loc& loc, Type* type, DValue* aa, DValue* key);
 DValue* DtoAARemove(Loc& loc, DValue* aa, DValue* key);
 LLValue* DtoAAEquals(Loc& loc, TOK op, DValue* l, DValue* r);
+#if DMDV2
+LLValue* DtoConstAALiteral(Type* aatype, Expressions* keys,
+    const std::vector<LLConstant*>& keysInits, const std::vector<LLConstant*>& valuesInits);
+#endif
 
 #endif // LDC_GEN_AA_H
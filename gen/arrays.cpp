@@ -1,4 +1,5 @@
 #include "gen/llvm.h"
+#include "llvm/Analysis/ValueTracking.h"
 
 #include "mtype.h"
 #include "module.h"
@@ -736,7 +737,13 @@ DSliceValue* DtoResizeDynArray(Type* arrayType, DValue* array, LLValue* newdim)
 
 void DtoCatAssignElement(Loc& loc, Type* arrayType, DValue* array, Expression* exp)
 {
-    Logger::println("DtoCatAssignElement");
+    DtoCatAssignElements(loc, arrayType, array, std::vector<Expression*>(1, exp));
+}
+
+// Appends all of exps to the array, growing it only once.
+void DtoCatAssignElements(Loc& loc, Type* arrayType, DValue* array, const std::vector<Expression*>& exps)
+{
+    Logger::println("DtoCatAssignElements");
     LOG_SCOPE;
 
     assert(array);
@@ -745,21 +752,61 @@ void DtoCatAssignElement(Loc& loc, Type* arrayType, DValue* array, Expression* e
 
     // Do not move exp->toElem call after creating _d_arrayappendcTX,
     // otherwise a ~= a[$-i] won't work correctly
-    DValue *expVal = exp->toElem(gIR);
+    std::vector<DValue*> expVals(exps.size(), NULL);
+    for (size_t i = 0; i < exps.size(); i++)
+        expVals[i] = exps[i]->toElem(gIR);
 
     LLFunction* fn = LLVM_D_GetRuntimeFunction(gIR->module, "_d_arrayappendcTX");
     LLSmallVector<LLValue*,3> args;
     args.push_back(DtoTypeInfoOf(arrayType));
     args.push_back(DtoBitCast(array->getLVal(), fn->getFunctionType()->getParamType(1)));
-    args.push_back(DtoConstSize_t(1));
+    args.push_back(DtoConstSize_t(exps.size()));
 
     LLValue* appendedArray = gIR->CreateCallOrInvoke(fn, args, ".appendedArray").getInstruction();
     appendedArray = DtoAggrPaint(appendedArray, DtoType(arrayType));
 
-    LLValue* val = DtoArrayPtr(array);
-    val = DtoGEP1(val, oldLength, "lastElem");
-    DtoAssign(loc, new DVarValue(arrayType->nextOf(), val), expVal);
-    callPostblit(loc, exp, val);
+    LLValue* ptr = DtoArrayPtr(array);
+    for (size_t i = 0; i < exps.size(); i++)
+    {
+        LLValue* index = i ? gIR->ir->CreateAdd(oldLength, DtoConstSize_t(i)) : oldLength;
+        LLValue* val = DtoGEP1(ptr, index, "lastElem");
+        DtoAssign(loc, new DVarValue(arrayType->nextOf(), val), expVals[i]);
+        callPostblit(loc, exps[i], val);
+    }
+}
+
+// Reserves capacity for count * elemsPerCount more elements in the array,
+// unless count is zero or the new capacity would overflow.
+void DtoReserveAppends(DValue* array, LLValue* count, unsigned elemsPerCount)
+{
+    Logger::println("DtoReserveAppends");
+    LOG_SCOPE;
+
+    assert(elemsPerCount > 0);
+    Type* arrayType = array->getType()->toBasetype();
+    LLValue* len = DtoArrayLen(array);
+
+    // count <= (size_t.max - len) / elemsPerCount
+    LLValue* room = gIR->ir->CreateSub(llvm::ConstantInt::getAllOnesValue(DtoSize_t()), len);
+    room = gIR->ir->CreateUDiv(room, DtoConstSize_t(elemsPerCount));
+    LLValue* cond = gIR->ir->CreateAnd(gIR->ir->CreateICmpNE(count, DtoConstSize_t(0)),
+                                       gIR->ir->CreateICmpULE(count, room));
+
+    llvm::BasicBlock* oldend = gIR->scopeend();
+    llvm::BasicBlock* reservebb = llvm::BasicBlock::Create(gIR->context(), "reserve", gIR->topfunc(), oldend);
+    llvm::BasicBlock* endbb = llvm::BasicBlock::Create(gIR->context(), "reserveend", gIR->topfunc(), oldend);
+    gIR->ir->CreateCondBr(cond, reservebb, endbb);
+
+    gIR->scope() = IRScope(reservebb, endbb);
+    LLValue* capacity = gIR->ir->CreateMul(count, DtoConstSize_t(elemsPerCount));
+    capacity = gIR->ir->CreateAdd(len, capacity, "capacity");
+
+    LLFunction* fn = LLVM_D_GetRuntimeFunction(gIR->module, "_d_arraysetcapacity");
+    gIR->CreateCallOrInvoke3(fn, DtoTypeInfoOf(arrayType), capacity,
+        DtoBitCast(array->getLVal(), fn->getFunctionType()->getParamType(2)));
+    gIR->ir->CreateBr(endbb);
+
+    gIR->scope() = IRScope(endbb, oldend);
 }
 
 #else
@@ -1095,11 +1142,156 @@ static LLValue* DtoArrayEqCmp_impl(Loc& loc, const char* func, DValue* l, DValue
     return call.getInstruction();
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////
+// constant strings up to this length are compared with a few wide loads
+static const size_t maxInlineStringCompare = 32;
+
+// returns true if arrays of l and r can be compared for equality with memcmp,
+// i.e. if equal elements are always bitwise equal
+static bool isBitwiseEqArray(DValue* l, DValue* r)
+{
+    Type* lt = l->getType()->toBasetype()->nextOf()->toBasetype();
+    Type* rt = r->getType()->toBasetype()->nextOf()->toBasetype();
+    if (lt->size() != rt->size())
+        return false;
+    for (int i = 0; i < 2; i++)
+    {
+        Type* t = i ? rt : lt;
+        if (!(t->isTypeBasic() && t->isintegral()) && t->ty != Tpointer && t->ty != Tvoid)
+            return false;
+    }
+    return true;
+}
+
+// compares len bytes at ptr with the constant str, with the widest loads possible
+static LLValue* DtoConstStringEquals(LLValue* ptr, const std::string& str)
+{
+    bool littleEndian = gTargetData->isLittleEndian();
+    LLValue* res = LLConstantInt::getTrue(gIR->context());
+    ptr = DtoBitCast(ptr, getVoidPtrType());
+
+    size_t offset = 0;
+    while (offset < str.size())
+    {
+        size_t width = 8;
+        while (width > str.size() - offset)
+            width /= 2;
+
+        uint64_t value = 0;
+        for (size_t i = 0; i < width; i++)
+        {
+            uint64_t c = (unsigned char)str[offset + i];
+            value |= c << (8 * (littleEndian ? i : width - 1 - i));
+        }
+
+        LLType* chunkTy = LLIntegerType::get(gIR->context(), 8 * width);
+        LLValue* chunkptr = gIR->ir->CreateGEP(ptr, DtoConstSize_t(offset));
+        llvm::LoadInst* chunk = gIR->ir->CreateLoad(DtoBitCast(chunkptr, getPtrToType(chunkTy)));
+        chunk->setAlignment(1);
+        LLValue* eq = gIR->ir->CreateICmpEQ(chunk, LLConstantInt::get(chunkTy, value));
+        res = gIR->ir->CreateAnd(res, eq);
+
+        offset += width;
+    }
+    return res;
+}
+
+// compares arrays whose elements have no opEquals by their length and bytes
+static LLValue* DtoInlineArrayEquals(Loc& loc, DValue* l, DValue* r)
+{
+    Logger::println("comparing arrays inline");
+
+    Type* commonType = l->getType()->toBasetype()->nextOf()->arrayOf();
+    l = DtoCastArray(loc, l, commonType);
+    r = DtoCastArray(loc, r, commonType);
+
+    LLValue* llen = DtoArrayLen(l);
+    LLValue* lptr = DtoArrayPtr(l);
+    LLValue* rlen = DtoArrayLen(r);
+    LLValue* rptr = DtoArrayPtr(r);
+
+    // a char array of known length compared with a constant string?
+    std::string str;
+    bool isConstStr = false;
+    if (getTypePaddedSize(lptr->getType()->getContainedType(0)) == 1)
+    {
+        if (isaConstantInt(llen) && !isaConstantInt(rlen))
+        {
+            std::swap(llen, rlen);
+            std::swap(lptr, rptr);
+        }
+        if (isaConstantInt(rlen) && llvm::GetConstantStringInfo(rptr, str, 0, false))
+        {
+            uint64_t n = isaConstantInt(rlen)->getZExtValue();
+            isConstStr = n <= maxInlineStringCompare && n <= str.size();
+            str.resize(n);
+        }
+    }
+
+    llvm::BasicBlock* oldend = gIR->scopeend();
+    llvm::BasicBlock* entrybb = gIR->scopebb();
+    llvm::BasicBlock* cmpbb = llvm::BasicBlock::Create(gIR->context(), "arrayeq.cmp", gIR->topfunc(), oldend);
+    llvm::BasicBlock* endbb = llvm::BasicBlock::Create(gIR->context(), "arrayeq.end", gIR->topfunc(), oldend);
+    gIR->ir->CreateCondBr(gIR->ir->CreateICmpEQ(llen, rlen), cmpbb, endbb);
+
+    // same length, compare the contents
+    gIR->scope() = IRScope(cmpbb, endbb);
+    LLValue* res;
+    if (isConstStr)
+    {
+        res = DtoConstStringEquals(lptr, str);
+    }
+    else
+    {
+        LLType* elemTy = lptr->getType()->getContainedType(0);
+        LLValue* nbytes = gIR->ir->CreateMul(llen, DtoConstSize_t(getTypePaddedSize(elemTy)));
+        res = gIR->ir->CreateICmpEQ(DtoMemCmp(lptr, rptr, nbytes), DtoConstInt(0));
+    }
+    llvm::BasicBlock* cmpendbb = gIR->scopebb();
+    gIR->ir->CreateBr(endbb);
+
+    gIR->scope() = IRScope(endbb, oldend);
+    llvm::PHINode* phi = gIR->ir->CreatePHI(LLType::getInt1Ty(gIR->context()), 2, "arrayeq");
+    phi->addIncoming(LLConstantInt::getFalse(gIR->context()), entrybb);
+    phi->addIncoming(res, cmpendbb);
+    return phi;
+}
+
+// lexicographically compares arrays of unsigned bytes, like _adCmpChar does
+static LLValue* DtoInlineArrayCompare(Loc& loc, DValue* l, DValue* r)
+{
+    Logger::println("comparing arrays inline");
+
+    Type* commonType = l->getType()->toBasetype()->nextOf()->arrayOf();
+    l = DtoCastArray(loc, l, commonType);
+    r = DtoCastArray(loc, r, commonType);
+
+    LLValue* llen = DtoArrayLen(l);
+    LLValue* rlen = DtoArrayLen(r);
+
+    LLValue* lshorter = gIR->ir->CreateICmpULT(llen, rlen);
+    LLValue* minlen = gIR->ir->CreateSelect(lshorter, llen, rlen);
+    LLValue* res = DtoMemCmp(DtoArrayPtr(l), DtoArrayPtr(r), minlen);
+
+    // equal prefixes, the shorter array is less
+    LLValue* lencmp = gIR->ir->CreateSelect(lshorter, DtoConstInt(-1),
+        gIR->ir->CreateSelect(gIR->ir->CreateICmpUGT(llen, rlen), DtoConstInt(1), DtoConstInt(0)));
+    return gIR->ir->CreateSelect(gIR->ir->CreateICmpEQ(res, DtoConstInt(0)), lencmp, res);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 LLValue* DtoArrayEquals(Loc& loc, TOK op, DValue* l, DValue* r)
 {
-    LLValue* res = DtoArrayEqCmp_impl(loc, _adEq, l, r, true);
-    res = gIR->ir->CreateICmpNE(res, DtoConstInt(0), "tmp");
+    LLValue* res;
+    if (isBitwiseEqArray(l, r))
+    {
+        res = DtoInlineArrayEquals(loc, l, r);
+    }
+    else
+    {
+        res = DtoArrayEqCmp_impl(loc, _adEq, l, r, true);
+        res = gIR->ir->CreateICmpNE(res, DtoConstInt(0), "tmp");
+    }
     if (op == TOKnotequal)
         res = gIR->ir->CreateNot(res, "tmp");
 
@@ -1154,7 +1346,11 @@ LLValue* DtoArrayCompare(Loc& loc, TOK op, DValue* l, DValue* r)
     if (!skip)
     {
         Type* t = l->getType()->toBasetype()->nextOf()->toBasetype();
-        if (t->ty == Tchar)
+        Type* rt = r->getType()->toBasetype()->nextOf()->toBasetype();
+        // unsigned bytes compare like memcmp does
+        if ((t->ty == Tchar || t->ty == Tuns8 || t->ty == Tvoid) && rt->size() == 1)
+            res = DtoInlineArrayCompare(loc, l, r);
+        else if (t->ty == Tchar)
             res = DtoArrayEqCmp_impl(loc, "_adCmpChar", l, r, false);
         else
             res = DtoArrayEqCmp_impl(loc, _adCmp, l, r, true);
@@ -1406,7 +1602,7 @@ void DtoArrayBoundsCheck(Loc& loc, DValue* arr, DValue* index, DValue* lowerBoun
     bool lengthUnknown = arrty->ty == Tpointer;
 
     llvm::BasicBlock* oldend = gIR->scopeend();
-    llvm::BasicBlock* failbb = llvm::BasicBlock::Create(gIR->context(), "arrayboundscheckfail", gIR->topfunc(), oldend);
+    llvm::BasicBlock* failbb = DtoCreateColdBlock("arrayboundscheckfail");
     llvm::BasicBlock* okbb = llvm::BasicBlock::Create(gIR->context(), "arrayboundsok", gIR->topfunc(), oldend);
     LLValue* cond = 0;
 
@@ -1419,16 +1615,16 @@ void DtoArrayBoundsCheck(Loc& loc, DValue* arr, DValue* index, DValue* lowerBoun
 
     if (!lowerBound) {
         assert(cond);
-        gIR->ir->CreateCondBr(cond, okbb, failbb);
+        DtoCondBrCold(cond, okbb, failbb);
     } else {
         if (!lengthUnknown) {
-            llvm::BasicBlock* locheckbb = llvm::BasicBlock::Create(gIR->context(), "arrayboundschecklowerbound", gIR->topfunc(), oldend);
-            gIR->ir->CreateCondBr(cond, locheckbb, failbb);
-            gIR->scope() = IRScope(locheckbb, failbb);
+            llvm::BasicBlock* locheckbb = llvm::BasicBlock::Create(gIR->context(), "arrayboundschecklowerbound", gIR->topfunc(), okbb);
+            DtoCondBrCold(cond, locheckbb, failbb);
+            gIR->scope() = IRScope(locheckbb, okbb);
         }
         // check for lower bound
         cond = gIR->ir->CreateICmp(llvm::ICmpInst::ICMP_ULE, lowerBound->getRVal(), index->getRVal(), "boundscheck");
-        gIR->ir->CreateCondBr(cond, okbb, failbb);
+        DtoCondBrCold(cond, okbb, failbb);
     }
 
     // set up failbb to call the array bounds error runtime function
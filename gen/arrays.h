@@ -31,6 +31,10 @@ DSliceValue* DtoNewMulDimDynArray(Loc& loc, Type* arrayType, DValue** dims, size
 DSliceValue* DtoResizeDynArray(Type* arrayType, DValue* array, llvm::Value* newdim);
 
 void DtoCatAssignElement(Loc& loc, Type* type, DValue* arr, Expression* exp);
+#if DMDV2
+void DtoCatAssignElements(Loc& loc, Type* type, DValue* arr, const std::vector<Expression*>& exps);
+void DtoReserveAppends(DValue* arr, LLValue* count, unsigned elemsPerCount);
+#endif
 DSliceValue* DtoCatAssignArray(DValue* arr, Expression* exp);
 DSliceValue* DtoCatArrays(Type* type, Expression* e1, Expression* e2);
 #if DMDV1
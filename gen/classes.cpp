@@ -1,4 +1,5 @@
 #include "gen/llvm.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "mtype.h"
 #include "aggregate.h"
@@ -23,6 +24,15 @@
 #include "ir/irstruct.h"
 #include "ir/irtypeclass.h"
 
+static llvm::cl::opt<bool> wholeProgramDevirt("whole-program-devirt",
+    llvm::cl::desc("Assume that no classes outside of this compilation derive from its classes, "
+                   "call virtual methods that are never overridden directly and check "
+                   "dynamic casts to classes without subclasses inline"));
+
+static llvm::cl::opt<bool> speculativeDevirt("speculative-devirt",
+    llvm::cl::desc("Call the only implementation of a virtual method known in this compilation "
+                   "directly if it is the one in the vtbl (-O2 and above)"));
+
 //////////////////////////////////////////////////////////////////////////////////////////
 
 // FIXME: this needs to be cleaned up
@@ -353,6 +363,15 @@ DValue* DtoCastClass(DValue* val, Type* _to)
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+// Returns true if no class can derive from cd, so that the ClassInfo of an
+// instance of cd is always cd's own.
+static bool isLeafClass(ClassDeclaration* cd)
+{
+    if (cd->isInterfaceDeclaration() || cd->isCOMclass())
+        return false;
+    return (cd->storage_class & STCfinal) || (wholeProgramDevirt && !cd->hasSubclasses);
+}
+
 DValue* DtoDynamicCastObject(DValue* val, Type* _to)
 {
     // call:
@@ -381,8 +400,40 @@ DValue* DtoDynamicCastObject(DValue* val, Type* _to)
     cinfo = DtoBitCast(cinfo, funcTy->getParamType(1));
     assert(funcTy->getParamType(1) == cinfo->getType());
 
-    // call it
-    LLValue* ret = gIR->CreateCallOrInvoke2(func, obj, cinfo, "tmp").getInstruction();
+    LLValue* ret;
+    if (isLeafClass(to->sym) && !((TypeClass*)val->getType()->toBasetype())->sym->isCOMclass())
+    {
+        // nothing derives from the target class, so the object is an
+        // instance of it exactly if its ClassInfo is the target's
+        Logger::println("inline exact class check");
+        llvm::BasicBlock* oldend = gIR->scopeend();
+        llvm::BasicBlock* nullbb = gIR->scopebb();
+        llvm::BasicBlock* checkbb = llvm::BasicBlock::Create(gIR->context(), "dyncastcheck", gIR->topfunc(), oldend);
+        llvm::BasicBlock* endbb = llvm::BasicBlock::Create(gIR->context(), "dyncastend", gIR->topfunc(), oldend);
+
+        LLValue* isnull = gIR->ir->CreateIsNull(obj, "tmp");
+        gIR->ir->CreateCondBr(isnull, endbb, checkbb);
+
+        // vtbl[0] is the ClassInfo
+        gIR->scope() = IRScope(checkbb, endbb);
+        LLValue* vtbl = DtoLoad(DtoGEPi(val->getRVal(), 0, 0));
+        LLValue* objcinfo = DtoBitCast(DtoLoad(DtoGEPi(vtbl, 0, 0)), cinfo->getType());
+        LLValue* match = gIR->ir->CreateICmpEQ(objcinfo, cinfo, "tmp");
+        LLValue* nullobj = LLConstant::getNullValue(obj->getType());
+        LLValue* castobj = gIR->ir->CreateSelect(match, obj, nullobj, "tmp");
+        llvm::BranchInst::Create(endbb, checkbb);
+
+        gIR->scope() = IRScope(endbb, oldend);
+        llvm::PHINode* phi = gIR->ir->CreatePHI(obj->getType(), 2, "tmp");
+        phi->addIncoming(nullobj, nullbb);
+        phi->addIncoming(castobj, checkbb);
+        ret = phi;
+    }
+    else
+    {
+        // call it
+        ret = gIR->CreateCallOrInvoke2(func, obj, cinfo, "tmp").getInstruction();
+    }
 
     // cast return value
     ret = DtoBitCast(ret, DtoType(_to));
@@ -505,6 +556,45 @@ LLValue* DtoIndexClass(LLValue* src, ClassDeclaration* cd, VarDeclaration* vd)
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+// Returns the implementation in cd's vtbl of the method fdecl, if it is
+// known to be the one called on every instance of cd.
+// If speculative is set, a method that merely has a single implementation
+// in this compilation is returned as well.
+static FuncDeclaration* DtoDevirtualize(ClassDeclaration* cd, FuncDeclaration* fdecl, bool speculative)
+{
+    // interface vtbls are laid out differently and hold thunks
+    ClassDeclaration* fcd = fdecl->toParent()->isClassDeclaration();
+    if (cd->isInterfaceDeclaration() || !fcd || fcd->isInterfaceDeclaration())
+        return NULL;
+    if (fdecl->vtblIndex >= (int)cd->vtbl.dim)
+        return NULL;
+
+    FuncDeclaration* impl = ((Dsymbol*)cd->vtbl.data[fdecl->vtblIndex])->isFuncDeclaration();
+    if (!impl || impl->isAbstract())
+    {
+        // unless it has a single implementation
+        if (!impl || impl->overrideCount != 1 || !(wholeProgramDevirt || speculative))
+            return NULL;
+        impl = impl->firstOverride;
+        if (impl->isAbstract() || impl->overrideCount != 0)
+            return NULL;
+        return impl;
+    }
+#if DMDV2
+    // the vtbl entry of a hidden function is _d_hidden_func
+    if (cd->isFuncHidden(impl))
+        return NULL;
+#endif
+
+    // nothing derives from a final class
+    if (cd->storage_class & STCfinal)
+        return impl;
+
+    if (impl->overrideCount == 0 && (wholeProgramDevirt || speculative))
+        return impl;
+    return NULL;
+}
+
 LLValue* DtoVirtualFunctionPointer(DValue* inst, FuncDeclaration* fdecl, char* name)
 {
     // sanity checks
@@ -513,6 +603,17 @@ LLValue* DtoVirtualFunctionPointer(DValue* inst, FuncDeclaration* fdecl, char* n
     assert(fdecl->vtblIndex > 0); // 0 is always ClassInfo/Interface*
     assert(inst->getType()->toBasetype()->ty == Tclass);
 
+    ClassDeclaration* cd = ((TypeClass*)inst->getType()->toBasetype())->sym;
+
+    // call the method directly if class hierarchy analysis tells which one it is
+    if (FuncDeclaration* impl = DtoDevirtualize(cd, fdecl, false))
+    {
+        Logger::println("devirtualized to %s", impl->toPrettyChars());
+        DtoResolveDsymbol(impl);
+        impl->codegen(Type::sir);
+        return DtoBitCast(impl->ir.irFunc->func, getPtrToType(DtoType(fdecl->type)));
+    }
+
     // get instance
     LLValue* vthis = inst->getRVal();
     if (Logger::enabled())
@@ -530,6 +631,18 @@ LLValue* DtoVirtualFunctionPointer(DValue* inst, FuncDeclaration* fdecl, char* n
     // load funcptr
     funcval = DtoAlignedLoad(funcval);
 
+    // let the optimizer guard calls to the only known implementation
+    FuncDeclaration* guess = speculativeDevirt ? DtoDevirtualize(cd, fdecl, true) : NULL;
+    if (guess)
+    {
+        Logger::println("speculatively devirtualized to %s", guess->toPrettyChars());
+        DtoResolveDsymbol(guess);
+        guess->codegen(Type::sir);
+        LLValue* target = DtoBitCast(guess->ir.irFunc->func, funcval->getType());
+        llvm::Instruction* load = llvm::cast<llvm::Instruction>(funcval);
+        load->setMetadata("ldc.devirt", llvm::MDNode::get(gIR->context(), target));
+    }
+
     if (Logger::enabled())
         Logger::cout() << "funcval: " << *funcval << '\n';
 
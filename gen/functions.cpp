@@ -24,6 +24,7 @@
 #include "gen/abi.h"
 #include "gen/nested.h"
 #include "gen/pragma.h"
+#include "driver/timetrace.h"
 
 using namespace llvm::Attribute;
 
@@ -642,6 +643,8 @@ void DtoDefineFunction(FuncDeclaration* fd)
         Logger::println("DtoDefineFunc(%s): %s", fd->toPrettyChars(), fd->loc.toChars());
     LOG_SCOPE;
 
+    TimeTraceScope timeScope("Codegen function", timeTraceEnabled ? fd->toPrettyChars() : NULL);
+
     // if this function is naked, we take over right away! no standard processing!
     if (fd->naked)
     {
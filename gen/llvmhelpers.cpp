@@ -209,6 +209,45 @@ void DtoAssert(Module* M, Loc loc, DValue* msg)
 }
 
 
+/****************************************************************************************/
+/*////////////////////////////////////////////////////////////////////////////////////////
+// RUNTIME ERROR PATH HELPERS
+////////////////////////////////////////////////////////////////////////////////////////*/
+
+// branch weights of the normal and the error path
+static const unsigned likelyBranchWeight = 2000;
+static const unsigned unlikelyBranchWeight = 1;
+
+llvm::BasicBlock* DtoCreateColdBlock(const char* name)
+{
+    // DtoDefineFunction removes the last block, endentry, so insert before it
+    llvm::Function* func = gIR->topfunc();
+    llvm::BasicBlock* insertBefore = func->empty() ? NULL : &func->back();
+    return llvm::BasicBlock::Create(gIR->context(), name, func, insertBefore);
+}
+
+llvm::BranchInst* DtoCondBrCold(LLValue* cond, llvm::BasicBlock* okbb, llvm::BasicBlock* coldbb)
+{
+    llvm::BranchInst* br = llvm::BranchInst::Create(okbb, coldbb, cond, gIR->scopebb());
+    LLValue* weights[] = {
+        llvm::MDString::get(gIR->context(), "branch_weights"),
+        DtoConstUint(likelyBranchWeight),
+        DtoConstUint(unlikelyBranchWeight)
+    };
+    br->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDNode::get(gIR->context(), weights));
+    return br;
+}
+
+void DtoSetColdDefault(llvm::SwitchInst* si)
+{
+    std::vector<LLValue*> weights;
+    weights.push_back(llvm::MDString::get(gIR->context(), "branch_weights"));
+    weights.push_back(DtoConstUint(unlikelyBranchWeight));
+    for (unsigned i = 1; i < si->getNumSuccessors(); i++)
+        weights.push_back(DtoConstUint(likelyBranchWeight));
+    si->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDNode::get(gIR->context(), weights));
+}
+
 /****************************************************************************************/
 /*////////////////////////////////////////////////////////////////////////////////////////
 // LABEL HELPER
@@ -1591,6 +1630,32 @@ void DtoOverloadedIntrinsicName(TemplateInstance* ti, TemplateDeclaration* td, s
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+bool isInlineableTemplateCopy(Dsymbol* s)
+{
+    if (global.params.singleObj || !global.params.dedupTemplates ||
+        !global.params.useAvailableExternally)
+        return false;
+
+    FuncDeclaration* fd = s->isFuncDeclaration();
+    if (!fd || !fd->fbody || fd->naked || fd->semanticRun < 4)
+        return false;
+
+    TemplateInstance* tinst = DtoIsTemplateInstance(fd);
+    if (!tinst || !tinst->emittedInModule || tinst->emittedInModule == gIR->dmodule)
+        return false;
+
+    // Like for availableExternally in mustDefineSymbol, another copy of a
+    // static constructor, static destructor or unittest would get
+    // registered to run.
+    if (fd->isStaticCtorDeclaration() || fd->isStaticDtorDeclaration() ||
+        fd->isUnitTestDeclaration())
+        return false;
+
+    return fd->canInline(fd->needThis());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
 bool mustDefineSymbol(Dsymbol* s)
 {
     if (FuncDeclaration* fd = s->isFuncDeclaration())
@@ -1648,7 +1713,7 @@ bool mustDefineSymbol(Dsymbol* s)
     TemplateInstance* tinst = DtoIsTemplateInstance(s);
     if (tinst)
     {
-        if (!global.params.singleObj)
+        if (!global.params.singleObj && !global.params.dedupTemplates)
             return true;
 
         if (!tinst->emittedInModule)
@@ -1656,7 +1721,13 @@ bool mustDefineSymbol(Dsymbol* s)
             gIR->seenTemplateInstances.insert(tinst);
             tinst->emittedInModule = gIR->dmodule;
         }
-        return tinst->emittedInModule == gIR->dmodule;
+        if (tinst->emittedInModule == gIR->dmodule)
+            return true;
+
+        // With -dedup-templates, the module owning the template instance
+        // defines it, but small functions are still emitted as
+        // available_externally so they can be inlined.
+        return isInlineableTemplateCopy(s);
     }
 
     return s->getModule() == gIR->dmodule;
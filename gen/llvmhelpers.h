@@ -50,6 +50,12 @@ LLValue* DtoGcMalloc(LLType* lltype, const char* name = "");
 // assertion generator
 void DtoAssert(Module* M, Loc loc, DValue* msg);
 
+// runtime error paths: the blocks are placed at the end of the current function,
+// and the branches to them are weighted as very unlikely
+llvm::BasicBlock* DtoCreateColdBlock(const char* name);
+llvm::BranchInst* DtoCondBrCold(LLValue* cond, llvm::BasicBlock* okbb, llvm::BasicBlock* coldbb);
+void DtoSetColdDefault(llvm::SwitchInst* si);
+
 // return the LabelStatement from the current function with the given identifier or NULL if not found
 LabelStatement* DtoLabelStatement(Identifier* ident);
 
@@ -133,6 +139,10 @@ void DtoOverloadedIntrinsicName(TemplateInstance* ti, TemplateDeclaration* td, s
 /// Returns true if the symbol should be defined in the current module, not just declared.
 bool mustDefineSymbol(Dsymbol* s);
 
+/// Returns true if the symbol is a function of a template instance owned by another
+/// module (see -dedup-templates) that is emitted available_externally for inlining.
+bool isInlineableTemplateCopy(Dsymbol* s);
+
 /// Returns true if the symbol needs template linkage, or just external.
 bool needsTemplateLinkage(Dsymbol* s);
 
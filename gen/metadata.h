@@ -1,5 +1,3 @@
-#if USE_METADATA
-
 #ifndef LDC_GEN_METADATA_H
 #define LDC_GEN_METADATA_H
 
@@ -7,13 +5,13 @@
 #include "llvm/Metadata.h"
 typedef llvm::Value MDNodeField;
 
-// Use getNumElements() and getElement() to access elements.
+// Use getNumOperands() and getOperand() to access elements.
 inline unsigned MD_GetNumElements(llvm::MDNode* N) {
-    return N->getNumElements();
+    return N->getNumOperands();
 }
 
 inline MDNodeField* MD_GetElement(llvm::MDNode* N, unsigned i) {
-    return N->getElement(i);
+    return N->getOperand(i);
 }
 
 #define METADATA_LINKAGE_TYPE  llvm::GlobalValue::WeakODRLinkage
@@ -48,5 +46,3 @@ enum ClassDataFields {
 };
 
 #endif
-
-#endif // USE_METADATA
@@ -268,7 +268,9 @@ llvm::Module* Module::genLLVMModule(llvm::LLVMContext& context, Ir* sir)
     sir->emitFunctionBodies();
 
     // for singleobj-compilation, fully emit all seen template instances
-    if (global.params.singleObj)
+    // (the same goes for template instances owned by this module if
+    // -dedup-templates is given)
+    if (global.params.singleObj || global.params.dedupTemplates)
     {
         while (!ir.seenTemplateInstances.empty())
         {
@@ -7,13 +7,18 @@
 #include "llvm/LinkAllPasses.h"
 #include "llvm/Analysis/LoopPass.h"
 #include "llvm/Analysis/Verifier.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/Target/TargetData.h"
+#include "llvm/Target/TargetLibraryInfo.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/PassNameParser.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 
 #include "root.h"       // error()
+#include <algorithm>    // std::min
 #include <cstring>      // strcmp();
+#include <sstream>
 
 using namespace llvm;
 
@@ -33,14 +38,14 @@ static cl::opt<unsigned char> optimizeLevel(
         clEnumValN(1, "O1", "Simple optimizations"),
         clEnumValN(2, "O2", "Good optimizations"),
         clEnumValN(3, "O3", "Aggressive optimizations"),
-        clEnumValN(4, "O4", "Link-time optimization"), //  not implemented?
-        clEnumValN(5, "O5", "Link-time optimization"), //  not implemented?
+        clEnumValN(4, "O4", "Link-time optimization (see -lto-export)"),
+        clEnumValN(5, "O5", "Link-time optimization (see -lto-export)"),
         clEnumValEnd),
     cl::init(0));
 
 static cl::opt<bool>
 verifyEach("verify-each",
-    cl::desc("Run verifier after each optimization pass"),
+    cl::desc("Run verifier after each explicitly specified pass and between the stages of -O<N>"),
     cl::Hidden,
     cl::ZeroOrMore);
 
@@ -59,11 +64,22 @@ disableGCToStack("disable-gc2stack",
     cl::desc("Disable promotion of GC allocations to stack memory in -O<N>"),
     cl::ZeroOrMore);
 
+static cl::opt<bool>
+disableBoundsCheckElim("disable-bce",
+    cl::desc("Disable elimination of redundant array bounds checks in -O<N>"),
+    cl::ZeroOrMore);
+
 static cl::opt<opts::BoolOrDefaultAdapter, false, opts::FlagParser>
 enableInlining("inlining",
     cl::desc("(*) Enable function inlining in -O<N>"),
     cl::ZeroOrMore);
 
+static cl::opt<unsigned>
+inlineThreshold("inlining-threshold",
+    cl::desc("Cost threshold for function inlining (default: 225, 275 for -O3)"),
+    cl::value_desc("n"),
+    cl::ZeroOrMore);
+
 // Determine whether or not to run the inliner as part of the default list of
 // optimization passes.
 // If not explicitly specified, treat as false for -O0-2, and true for -O3.
@@ -90,127 +106,118 @@ int optLevel() {
     return optimizeLevel;
 }
 
+bool linkTimeOptimization() {
+    return optimizeLevel >= 4;
+}
+
 bool optimize() {
     return optimizeLevel || doInline() || !passList.empty();
 }
 
+static unsigned inliningThreshold() {
+    if (inlineThreshold.getNumOccurrences() != 0)
+        return inlineThreshold;
+    return optimizeLevel >= 3 ? 275 : 225;
+}
+
+std::string optimizerSettings() {
+    std::ostringstream out;
+    out << "O" << (int)optimizeLevel
+        << " inline=" << doInline() << "/" << inliningThreshold()
+        << " d-passes=" << !disableLangSpecificPasses
+        << " drtcalls=" << !disableSimplifyRuntimeCalls
+        << " gc2stack=" << !disableGCToStack
+        << " bce=" << !disableBoundsCheckElim;
+    // -O<N> may be placed anywhere between the explicit passes, so record
+    // the positions as well.
+    if (!passList.empty())
+        out << "@" << (optimizeLevel != 0 ? optimizeLevel.getPosition()
+                                          : enableInlining.getPosition());
+    for (size_t i = 0; i < passList.size(); i++) {
+        const char* arg = passList[i]->getPassArgument();
+        out << " -" << (arg ? arg : passList[i]->getPassName())
+            << "@" << passList.getPosition(i);
+    }
+    return out.str();
+}
+
 static void addPass(PassManager& pm, Pass* pass) {
     pm.add(pass);
 
     if (verifyEach) pm.add(createVerifierPass());
 }
 
-// this function inserts some or all of the std-compile-opts passes depending on the
-// optimization level given.
-static void addPassesForOptLevel(PassManager& pm) {
-    // -O1
-    if (optimizeLevel >= 1)
-    {
-        //addPass(pm, createStripDeadPrototypesPass());
-        addPass(pm, createGlobalDCEPass());
-        addPass(pm, createPromoteMemoryToRegisterPass());
-        addPass(pm, createCFGSimplificationPass());
-        if (optimizeLevel == 1)
-            addPass(pm, createPromoteMemoryToRegisterPass());
-        else
-            addPass(pm, createScalarReplAggregatesPass());
-        addPass(pm, createGlobalOptimizerPass());
-    }
+// Extension point callbacks for the D-specific passes.
+static void addDRuntimePasses(const PassManagerBuilder& builder, PassManagerBase& pm) {
+    if (builder.OptLevel < 2 || disableLangSpecificPasses)
+        return;
 
-    // -O2
-    if (optimizeLevel >= 2)
-    {
-        addPass(pm, createIPConstantPropagationPass());
-        addPass(pm, createDeadArgEliminationPass());
-        addPass(pm, createInstructionCombiningPass());
-        addPass(pm, createCFGSimplificationPass());
-        addPass(pm, createPruneEHPass());
-        
-        // FIXME: Adding this pass crashes LLVM 2.9 in
-        // PMTopLevelManager::schedulePass(), commented out for a quick fix.
-        // addPass(pm, createFunctionAttrsPass());
+    if (!disableSimplifyRuntimeCalls)
+        pm.add(createSimplifyDRuntimeCalls());
 
-        addPass(pm, createTailCallEliminationPass());
-        addPass(pm, createCFGSimplificationPass());
-        addPass(pm, createGVNPass());
-    }
+    if (!disableGCToStack)
+        pm.add(createGarbageCollect2Stack());
 
-    // -inline
-    if (doInline()) {
-        addPass(pm, createFunctionInliningPass());
-
-        if (optimizeLevel >= 2) {
-            // Run some optimizations to clean up after inlining.
-            addPass(pm, createScalarReplAggregatesPass());
-            addPass(pm, createInstructionCombiningPass());
-            // -instcombine + gvn == devirtualization :)
-            addPass(pm, createGVNPass());
-
-            // Inline again, to catch things like now nonvirtual
-            // function calls, foreach delegates passed to inlined
-            // opApply's, etc. where the actual function being called
-            // wasn't known during the first inliner pass.
-            addPass(pm, createFunctionInliningPass());
-        }
+    if (!disableBoundsCheckElim) {
+        pm.add(createBoundsCheckElimination());
+        // Create versions of the loops without the checks that were
+        // combined with a check in the preheader.
+        pm.add(createLoopUnswitchPass());
     }
 
-    if (optimizeLevel >= 2) {
-        if (!disableLangSpecificPasses) {
-            if (!disableSimplifyRuntimeCalls)
-                addPass(pm, createSimplifyDRuntimeCalls());
+    // Clean up after the runtime calls have been simplified or removed.
+    pm.add(createInstructionCombiningPass());
+    pm.add(createScalarReplAggregatesPass());
+    pm.add(createCFGSimplificationPass());
+}
 
-#if USE_METADATA
-            if (!disableGCToStack)
-                addPass(pm, createGarbageCollect2Stack());
-#endif // USE_METADATA
-        }
-        // Run some clean-up passes
-        addPass(pm, createInstructionCombiningPass());
-        addPass(pm, createScalarReplAggregatesPass());
-        addPass(pm, createCFGSimplificationPass());
-        addPass(pm, createInstructionCombiningPass());
+// Extension point callback for -verify-each; the passes of the standard
+// pipeline can't be verified one at a time.
+static void addVerifierPass(const PassManagerBuilder& builder, PassManagerBase& pm) {
+    pm.add(createVerifierPass());
+}
+
+// this function inserts the standard optimization pipeline for the given
+// optimization level, with the D-specific passes hooked in at the
+// PassManagerBuilder extension points.
+static void addPassesForOptLevel(PassManager& pm, llvm::Module* m) {
+    PassManagerBuilder builder;
+    // -O4 and -O5 additionally enable link-time optimization.
+    builder.OptLevel = std::min<unsigned>(optimizeLevel, 3);
+    builder.LibraryInfo = new TargetLibraryInfo(Triple(m->getTargetTriple()));
+
+    if (doInline())
+        builder.Inliner = createFunctionInliningPass(inliningThreshold());
+
+    builder.addExtension(PassManagerBuilder::EP_ScalarOptimizerLate, addDRuntimePasses);
+    // EP_EarlyAsPossible only applies to populateFunctionPassManager, which
+    // is not used; addPass verifies the early passes below.
+    if (verifyEach) {
+        builder.addExtension(PassManagerBuilder::EP_LoopOptimizerEnd, addVerifierPass);
+        builder.addExtension(PassManagerBuilder::EP_ScalarOptimizerLate, addVerifierPass);
     }
 
-    // -O3
-    if (optimizeLevel >= 3)
-    {
-        addPass(pm, createArgumentPromotionPass());
-        addPass(pm, createSimplifyLibCallsPass());
-        addPass(pm, createInstructionCombiningPass());
-        addPass(pm, createJumpThreadingPass());
+    // The per-function passes clang runs before the module pipeline.
+    if (optimizeLevel >= 1) {
+        addPass(pm, createTypeBasedAliasAnalysisPass());
+        addPass(pm, createBasicAliasAnalysisPass());
         addPass(pm, createCFGSimplificationPass());
         addPass(pm, createScalarReplAggregatesPass());
-        addPass(pm, createInstructionCombiningPass());
-        addPass(pm, createConstantPropagationPass());
-
-        addPass(pm, createReassociatePass());
-        addPass(pm, createLoopRotatePass());
-        addPass(pm, createLICMPass());
-        addPass(pm, createLoopUnswitchPass());
-        addPass(pm, createInstructionCombiningPass());
-        addPass(pm, createIndVarSimplifyPass());
-        addPass(pm, createLoopDeletionPass());
-        addPass(pm, createLoopUnrollPass());
-        addPass(pm, createInstructionCombiningPass());
-        addPass(pm, createGVNPass());
-        addPass(pm, createMemCpyOptPass());
-        addPass(pm, createSCCPPass());
-
-        addPass(pm, createInstructionCombiningPass());
-        addPass(pm, createConstantPropagationPass());
-
-        addPass(pm, createDeadStoreEliminationPass());
-        addPass(pm, createAggressiveDCEPass());
-        addPass(pm, createCFGSimplificationPass());
-        addPass(pm, createConstantMergePass());
+        addPass(pm, createEarlyCSEPass());
     }
 
+    // Guard the calls devirtualized by -speculative-devirt before the
+    // inliner gets to see them.
+    if (optimizeLevel >= 2 && !disableLangSpecificPasses)
+        addPass(pm, createSpeculativeDevirtualization());
+
+    builder.populateModulePassManager(pm);
+    if (verifyEach) pm.add(createVerifierPass());
+
     if (optimizeLevel >= 1) {
         addPass(pm, createStripExternalsPass());
         addPass(pm, createGlobalDCEPass());
     }
-
-    // level -O4 and -O5 are linktime optimizations
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -236,7 +243,7 @@ bool ldc_optimize_module(llvm::Module* m)
     for (size_t i = 0; i < passList.size(); i++) {
         // insert -O<N> / -enable-inlining in right position
         if (optimize && optPos < passList.getPosition(i)) {
-            addPassesForOptLevel(pm);
+            addPassesForOptLevel(pm, m);
             optimize = false;
         }
 
@@ -254,8 +261,38 @@ bool ldc_optimize_module(llvm::Module* m)
     }
     // insert -O<N> / -enable-inlining if specified at the end,
     if (optimize)
-        addPassesForOptLevel(pm);
+        addPassesForOptLevel(pm, m);
 
     pm.run(*m);
     return true;
 }
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// This function runs the interprocedural passes on the program merged from all
+// bitcode object files at link time (-O4/-O5).
+void ldc_optimize_lto_module(llvm::Module* m, const std::vector<const char*>* exports)
+{
+    PassManager pm;
+
+    if (verifyEach) pm.add(createVerifierPass());
+
+    addPass(pm, new TargetData(m));
+
+    // Everything the native code outside of the merged module does not
+    // reference is now known to be unused or internal.
+    if (exports)
+        addPass(pm, createInternalizePass(*exports));
+
+    PassManagerBuilder builder;
+    builder.OptLevel = 3;
+    builder.populateLTOPassManager(pm, /*Internalize=*/false, /*RunInliner=*/true);
+
+    // Inlining across modules exposes new opportunities for the D-specific
+    // passes.
+    addDRuntimePasses(builder, pm);
+
+    addPass(pm, createStripExternalsPass());
+    addPass(pm, createGlobalDCEPass());
+
+    pm.run(*m);
+}
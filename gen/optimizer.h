@@ -1,10 +1,17 @@
 #ifndef LDC_GEN_OPTIMIZER_H
 #define LDC_GEN_OPTIMIZER_H
 
+#include <string>
+#include <vector>
+
 namespace llvm { class Module; }
 
 bool ldc_optimize_module(llvm::Module* m);
 
+// Runs the link-time optimization pipeline over the merged program.
+// All symbols not in exports are internalized, unless exports is null.
+void ldc_optimize_lto_module(llvm::Module* m, const std::vector<const char*>* exports);
+
 // Determines whether the inliner will run in the -O<N> list of passes
 bool doInline();
 // Determines whether the inliner will be run at all.
@@ -12,7 +19,13 @@ bool willInline();
 
 int optLevel();
 
+// Determines whether -O4/-O5 link-time optimization is enabled.
+bool linkTimeOptimization();
+
 bool optimize();
 
+// Describes all optimizer settings, for use in cache keys.
+std::string optimizerSettings();
+
 #endif
 
@@ -0,0 +1,368 @@
+//===- BoundsCheckElimination - Remove redundant array bounds checks ------===//
+//
+//                             The LLVM D Compiler
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file removes array bounds checks that are known to succeed, either
+// because scalar evolution can prove the index to be in range or because an
+// equivalent or stronger check dominates them.
+//
+// A check of an induction variable against a loop-invariant length that
+// cannot be proven is combined with a single check of the index's last value
+// in the loop preheader, so that loop unswitching can create a version of
+// the loop without any checks.
+//
+// Finally, the blocks calling _d_array_bounds are merged into a single one
+// per function.
+//
+// A bounds check is recognized as a conditional branch on "icmp ult/ule" whose
+// false successor calls _d_array_bounds, as emitted by DtoArrayBoundsCheck.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "dbce"
+
+#include "Passes.h"
+
+#include "llvm/Pass.h"
+#include "llvm/Module.h"
+#include "llvm/Constants.h"
+#include "llvm/Instructions.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/CFG.h"
+#include "llvm/Analysis/Dominators.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+STATISTIC(NumProven, "Number of bounds checks removed because the index is known to be in range");
+STATISTIC(NumDominated, "Number of bounds checks removed because of a dominating check");
+STATISTIC(NumWidened, "Number of loop bounds checks combined with a check in the preheader");
+STATISTIC(NumMerged, "Number of bounds check failure blocks merged");
+
+namespace {
+    /// A branch on "Index <u Length" (or <=u for slices) that calls
+    /// _d_array_bounds if it fails.
+    struct BoundsCheck {
+        BranchInst* Br;
+        ICmpInst* Cmp;
+
+        BasicBlock* getBlock() const { return Br->getParent(); }
+        BasicBlock* getOkBlock() const { return Br->getSuccessor(0); }
+        BasicBlock* getFailBlock() const { return Br->getSuccessor(1); }
+        Value* getIndex() const { return Cmp->getOperand(0); }
+        Value* getLength() const { return Cmp->getOperand(1); }
+        ICmpInst::Predicate getPredicate() const { return Cmp->getPredicate(); }
+    };
+
+    /// A check of the last value of an induction variable in a preheader.
+    struct PreCheck {
+        Loop* L;
+        ICmpInst::Predicate Pred;
+        const SCEV* Max;
+        Value* Length;
+        Value* Cond;
+    };
+}
+
+/// Returns the call to _d_array_bounds in BB, if any.
+static CallSite getBoundsFailCall(BasicBlock* BB) {
+    for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I) {
+        CallSite CS(I);
+        if (!CS.getInstruction())
+            continue;
+        Function* Callee = CS.getCalledFunction();
+        if (Callee && Callee->getName() == "_d_array_bounds")
+            return CS;
+    }
+    return CallSite();
+}
+
+static bool getBoundsCheck(BasicBlock* BB, BoundsCheck& Check) {
+    BranchInst* Br = dyn_cast<BranchInst>(BB->getTerminator());
+    if (!Br || !Br->isConditional())
+        return false;
+    ICmpInst* Cmp = dyn_cast<ICmpInst>(Br->getCondition());
+    if (!Cmp || (Cmp->getPredicate() != ICmpInst::ICMP_ULT &&
+                 Cmp->getPredicate() != ICmpInst::ICMP_ULE))
+        return false;
+    if (!getBoundsFailCall(Br->getSuccessor(1)).getInstruction())
+        return false;
+    Check.Br = Br;
+    Check.Cmp = Cmp;
+    return true;
+}
+
+/// Returns true if "Known" succeeding implies that "Check" succeeds.
+static bool implies(const BoundsCheck& Known, const BoundsCheck& Check) {
+    if (Known.getLength() != Check.getLength())
+        return false;
+    bool KnownStrict = Known.getPredicate() == ICmpInst::ICMP_ULT;
+    bool Strict = Check.getPredicate() == ICmpInst::ICMP_ULT;
+
+    if (Known.getIndex() == Check.getIndex())
+        return KnownStrict || !Strict;
+
+    // Constant indices: a[5] implies a[3].
+    ConstantInt* KnownIdx = dyn_cast<ConstantInt>(Known.getIndex());
+    ConstantInt* Idx = dyn_cast<ConstantInt>(Check.getIndex());
+    if (!KnownIdx || !Idx)
+        return false;
+    if (KnownStrict || !Strict)
+        return Idx->getValue().ule(KnownIdx->getValue());
+    return Idx->getValue().ult(KnownIdx->getValue());
+}
+
+namespace {
+    /// This pass removes redundant array bounds checks.
+    ///
+    class LLVM_LIBRARY_VISIBILITY BoundsCheckElimination : public FunctionPass {
+        DominatorTree* DT;
+        LoopInfo* LI;
+        ScalarEvolution* SE;
+
+        SmallVector<PreCheck, 4> PreChecks;
+
+        bool isProven(const BoundsCheck& Check);
+        bool isDominated(const BoundsCheck& Check, SmallVectorImpl<BoundsCheck>& Kept);
+        bool widen(const BoundsCheck& Check);
+        void remove(const BoundsCheck& Check);
+        bool mergeFailBlocks(Function& F);
+
+    public:
+        static char ID; // Pass identification
+        BoundsCheckElimination() : FunctionPass(ID) {}
+
+        bool runOnFunction(Function &F);
+
+        virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+          AU.addRequired<DominatorTree>();
+          AU.addRequired<LoopInfo>();
+          AU.addRequired<ScalarEvolution>();
+        }
+    };
+    char BoundsCheckElimination::ID = 0;
+} // end anonymous namespace.
+
+static RegisterPass<BoundsCheckElimination>
+X("dbce", "Remove redundant array bounds checks");
+
+// Public interface to the pass.
+FunctionPass *createBoundsCheckElimination() {
+  return new BoundsCheckElimination();
+}
+
+/// Returns true if scalar evolution can prove that Check always succeeds,
+/// e.g. for a[i] in a loop over i < a.length.
+bool BoundsCheckElimination::isProven(const BoundsCheck& Check) {
+    if (!SE->isSCEVable(Check.getIndex()->getType()))
+        return false;
+    const SCEV* Index = SE->getSCEV(Check.getIndex());
+    const SCEV* Length = SE->getSCEV(Check.getLength());
+    return SE->isKnownPredicate(Check.getPredicate(), Index, Length);
+}
+
+/// Returns true if a check in Kept that is known to have succeeded whenever
+/// Check is reached implies that Check succeeds as well.
+bool BoundsCheckElimination::isDominated(const BoundsCheck& Check,
+                                         SmallVectorImpl<BoundsCheck>& Kept) {
+    for (size_t i = 0; i < Kept.size(); i++) {
+        BasicBlock* Ok = Kept[i].getOkBlock();
+        if (Ok->getSinglePredecessor() == Kept[i].getBlock() &&
+                DT->dominates(Ok, Check.getBlock()) && implies(Kept[i], Check))
+            return true;
+    }
+    return false;
+}
+
+/// If Check tests an induction variable against a loop-invariant length,
+/// checks the last value of the variable in the loop preheader, and lets the
+/// check in the loop succeed if that one did.
+bool BoundsCheckElimination::widen(const BoundsCheck& Check) {
+    Loop* L = LI->getLoopFor(Check.getBlock());
+    if (!L)
+        return false;
+    BasicBlock* Preheader = L->getLoopPreheader();
+    if (!Preheader)
+        return false;
+
+    Value* Length = Check.getLength();
+    if (Instruction* LengthInst = dyn_cast<Instruction>(Length)) {
+        if (!DT->dominates(LengthInst->getParent(), Preheader))
+            return false;
+    }
+
+    if (!SE->isSCEVable(Check.getIndex()->getType()))
+        return false;
+    const SCEVAddRecExpr* Index = dyn_cast<SCEVAddRecExpr>(SE->getSCEV(Check.getIndex()));
+    if (!Index || Index->getLoop() != L || !Index->isAffine() ||
+            !Index->getNoWrapFlags(SCEV::FlagNUW))
+        return false;
+    const SCEVConstant* Step = dyn_cast<SCEVConstant>(Index->getStepRecurrence(*SE));
+    if (!Step || !Step->getValue()->getValue().isStrictlyPositive())
+        return false;
+
+    // The index increases without wrapping, so its largest value is the one
+    // in the last iteration.
+    const SCEV* Count = SE->getBackedgeTakenCount(L);
+    if (isa<SCEVCouldNotCompute>(Count))
+        return false;
+    Count = SE->getTruncateOrZeroExtend(Count, Index->getType());
+    const SCEV* Max = Index->evaluateAtIteration(Count, *SE);
+    if (!SE->isLoopInvariant(Max, L))
+        return false;
+
+    ICmpInst::Predicate Pred = Check.getPredicate();
+    Value* Cond = 0;
+    for (size_t i = 0; i < PreChecks.size(); i++) {
+        const PreCheck& P = PreChecks[i];
+        if (P.L == L && P.Pred == Pred && P.Max == Max && P.Length == Length) {
+            Cond = P.Cond;
+            break;
+        }
+    }
+    if (!Cond) {
+        Instruction* InsertPt = Preheader->getTerminator();
+        SCEVExpander Expander(*SE, "dbce");
+        Value* MaxVal = Expander.expandCodeFor(Max, Index->getType(), InsertPt);
+        Cond = new ICmpInst(InsertPt, Pred, MaxVal, Length, "boundsprecheck");
+        PreCheck P = { L, Pred, Max, Length, Cond };
+        PreChecks.push_back(P);
+    }
+
+    DEBUG(errs() << "Widening bounds check: " << *Check.Cmp << '\n');
+    Check.Br->setCondition(BinaryOperator::CreateOr(Cond, Check.Cmp, "boundscheck", Check.Br));
+    return true;
+}
+
+/// Replaces the branch of Check by one to the ok block. The failure block
+/// is left for -simplifycfg to clean up if it became unreachable.
+void BoundsCheckElimination::remove(const BoundsCheck& Check) {
+    DEBUG(errs() << "Removing bounds check: " << *Check.Cmp << '\n');
+    BasicBlock* BB = Check.getBlock();
+    Check.getFailBlock()->removePredecessor(BB);
+    BranchInst::Create(Check.getOkBlock(), Check.Br);
+    Check.Br->eraseFromParent();
+    if (Check.Cmp->use_empty())
+        Check.Cmp->eraseFromParent();
+}
+
+/// Merges the blocks that only call _d_array_bounds into a single one, with
+/// the arguments of the calls passed through phis.
+bool BoundsCheckElimination::mergeFailBlocks(Function& F) {
+    SmallVector<BasicBlock*, 16> FailBlocks;
+    for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB) {
+        if (pred_begin(BB) == pred_end(BB))
+            continue;
+        CallSite CS = getBoundsFailCall(BB);
+        if (!CS.getInstruction() || !CS.isCall())
+            continue;
+        // Only the call and the unreachable, with arguments from elsewhere.
+        if (BB->size() != 2 || !isa<UnreachableInst>(BB->getTerminator()))
+            continue;
+        bool LocalArgs = false;
+        for (CallSite::arg_iterator A = CS.arg_begin(), AE = CS.arg_end(); A != AE; ++A) {
+            Instruction* ArgInst = dyn_cast<Instruction>(*A);
+            if (ArgInst && ArgInst->getParent() == BB)
+                LocalArgs = true;
+        }
+        if (!LocalArgs)
+            FailBlocks.push_back(BB);
+    }
+    if (FailBlocks.size() < 2)
+        return false;
+
+    BasicBlock* Merged = BasicBlock::Create(F.getContext(), "arrayboundscheckfail", &F);
+    CallInst* FirstCall = cast<CallInst>(getBoundsFailCall(FailBlocks[0]).getInstruction());
+
+    SmallVector<Value*, 4> Args;
+    for (unsigned a = 0; a < FirstCall->getNumArgOperands(); a++) {
+        Value* Arg = FirstCall->getArgOperand(a);
+        bool Same = true;
+        for (size_t i = 1; i < FailBlocks.size() && Same; i++)
+            Same = getBoundsFailCall(FailBlocks[i]).getArgument(a) == Arg;
+        if (Same) {
+            Args.push_back(Arg);
+            continue;
+        }
+        PHINode* Phi = PHINode::Create(Arg->getType(), FailBlocks.size(), "", Merged);
+        for (size_t i = 0; i < FailBlocks.size(); i++) {
+            Value* V = getBoundsFailCall(FailBlocks[i]).getArgument(a);
+            for (pred_iterator PI = pred_begin(FailBlocks[i]), PE = pred_end(FailBlocks[i]); PI != PE; ++PI)
+                Phi->addIncoming(V, *PI);
+        }
+        Args.push_back(Phi);
+    }
+
+    CallInst* Call = CallInst::Create(FirstCall->getCalledValue(), Args, "", Merged);
+    Call->setCallingConv(FirstCall->getCallingConv());
+    Call->setAttributes(FirstCall->getAttributes());
+    new UnreachableInst(F.getContext(), Merged);
+
+    for (size_t i = 0; i < FailBlocks.size(); i++) {
+        BasicBlock* BB = FailBlocks[i];
+        SmallVector<BasicBlock*, 4> Preds(pred_begin(BB), pred_end(BB));
+        for (size_t p = 0; p < Preds.size(); p++)
+            Preds[p]->getTerminator()->replaceUsesOfWith(BB, Merged);
+        BB->eraseFromParent();
+        ++NumMerged;
+    }
+    return true;
+}
+
+/// runOnFunction - Top level algorithm.
+///
+bool BoundsCheckElimination::runOnFunction(Function &F) {
+    DEBUG(errs() << "\nRunning -dbce on function " << F.getName() << '\n');
+
+    DT = &getAnalysis<DominatorTree>();
+    LI = &getAnalysis<LoopInfo>();
+    SE = &getAnalysis<ScalarEvolution>();
+    PreChecks.clear();
+
+    // Visit the blocks in dominator tree order, so that the checks that
+    // dominate a check have been seen before it.
+    SmallVector<BoundsCheck, 32> Checks;
+    for (df_iterator<DomTreeNode*> DI = df_begin(DT->getRootNode()),
+         DE = df_end(DT->getRootNode()); DI != DE; ++DI) {
+        BoundsCheck Check;
+        if (getBoundsCheck(DI->getBlock(), Check))
+            Checks.push_back(Check);
+    }
+
+    bool Changed = false;
+    SmallVector<BoundsCheck, 32> Kept;
+    for (size_t i = 0; i < Checks.size(); i++) {
+        const BoundsCheck& Check = Checks[i];
+        if (isProven(Check)) {
+            ++NumProven;
+        } else if (isDominated(Check, Kept)) {
+            ++NumDominated;
+        } else {
+            Kept.push_back(Check);
+            if (widen(Check)) {
+                ++NumWidened;
+                Changed = true;
+            }
+            continue;
+        }
+        remove(Check);
+        Changed = true;
+    }
+
+    Changed |= mergeFailBlocks(F);
+    return Changed;
+}
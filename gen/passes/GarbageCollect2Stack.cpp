@@ -1,5 +1,3 @@
-#if USE_METADATA
-
 //===- GarbageCollect2Stack - Optimize calls to the D garbage collector ---===//
 //
 //                             The LLVM D Compiler
@@ -12,6 +10,10 @@
 // This file attempts to turn allocations on the garbage-collected heap into
 // stack allocations.
 //
+// That includes the frames of functions with closures: once the callees a
+// delegate is passed to have been inlined, or have been found not to capture
+// their context pointer, the frame often turns out not to escape.
+//
 //===----------------------------------------------------------------------===//
 
 #include "gen/metadata.h"
@@ -29,6 +31,7 @@
 #include "llvm/Support/IRBuilder.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Analysis/Dominators.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Target/TargetData.h"
 #include "llvm/ADT/SmallSet.h"
@@ -39,12 +42,23 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include "gen/runtime.h"
+
 using namespace llvm;
 
 STATISTIC(NumGcToStack, "Number of calls promoted to constant-size allocas");
 STATISTIC(NumToDynSize, "Number of calls promoted to dynamically-sized allocas");
+STATISTIC(NumInLoops, "Number of dynamically-sized allocas released every loop iteration");
 STATISTIC(NumDeleted, "Number of GC calls deleted because the return value was unused");
+STATISTIC(NumTooLarge, "Number of GC calls not promoted because of the size limits");
+
+static cl::opt<unsigned> SizeLimit("dgc2stack-size-limit",
+    cl::desc("Maximum size in bytes of a single GC allocation promoted to the stack"),
+    cl::init(1024));
 
+static cl::opt<unsigned> FunctionSizeLimit("dgc2stack-function-limit",
+    cl::desc("Maximum number of bytes of GC allocations promoted to the stack per function"),
+    cl::init(4096));
 
 namespace {
     struct Analysis {
@@ -53,7 +67,7 @@ namespace {
         CallGraph* CG;
         CallGraphNode* CGNode;
         
-        const Type* getTypeFor(Value* typeinfo) const;
+        Type* getTypeFor(Value* typeinfo) const;
     };
 }
 
@@ -65,16 +79,10 @@ void EmitMemSet(IRBuilder<>& B, Value* Dst, Value* Val, Value* Len,
                 const Analysis& A) {
     Dst = B.CreateBitCast(Dst, PointerType::getUnqual(B.getInt8Ty()));
     
-    Module *M = B.GetInsertBlock()->getParent()->getParent();
-    const Type* intTy = Len->getType();
-    const Type *VoidPtrTy = PointerType::getUnqual(B.getInt8Ty());
-    const Type *Tys[2] ={VoidPtrTy, intTy};
-    Function *MemSet = Intrinsic::getDeclaration(M, Intrinsic::memset, Tys, 2);
-    Value *Align = ConstantInt::get(B.getInt32Ty(), 1);
-    
-    CallSite CS = B.CreateCall5(MemSet, Dst, Val, Len, Align, B.getFalse());
+    CallSite CS = B.CreateMemSet(Dst, Val, Len, 1 /*Align*/);
     if (A.CGNode)
-        A.CGNode->addCalledFunction(CS, A.CG->getOrInsertFunction(MemSet));
+        A.CGNode->addCalledFunction(CS,
+            A.CG->getOrInsertFunction(CS.getCalledFunction()));
 }
 
 static void EmitMemZero(IRBuilder<>& B, Value* Dst, Value* Len,
@@ -82,6 +90,9 @@ static void EmitMemZero(IRBuilder<>& B, Value* Dst, Value* Len,
     EmitMemSet(B, Dst, ConstantInt::get(B.getInt8Ty(), 0), Len, A);
 }
 
+// GC memory is 16-byte aligned, and code may rely on that.
+static const unsigned GCAlignment = 16;
+
 
 //===----------------------------------------------------------------------===//
 // Helpers for specific types of GC calls.
@@ -90,31 +101,47 @@ static void EmitMemZero(IRBuilder<>& B, Value* Dst, Value* Len,
 namespace {
     class FunctionInfo {
     protected:
-        const Type* Ty;
+        Type* Ty;
         
     public:
         unsigned TypeInfoArgNr;
         bool SafeToDelete;
+
+        // Upper bound for the number of bytes allocated by the current call,
+        // set by analyze().
+        uint64_t MaxSize;
         
         // Analyze the current call, filling in some fields. Returns true if
         // this is an allocation we can stack-allocate.
         virtual bool analyze(CallSite CS, const Analysis& A) {
             Value* TypeInfo = CS.getArgument(TypeInfoArgNr);
             Ty = A.getTypeFor(TypeInfo);
-            return (Ty != NULL);
+            if (!Ty)
+                return false;
+            MaxSize = A.TD.getTypeAllocSize(Ty);
+            return true;
+        }
+
+        // Returns whether the allocation size depends on a runtime value.
+        virtual bool isDynamicSize() const {
+            return false;
         }
         
         // Returns the alloca to replace this call.
         // It will always be inserted before the call.
-        virtual AllocaInst* promote(CallSite CS, IRBuilder<>& B, const Analysis& A) {
+        virtual Value* promote(CallSite CS, IRBuilder<>& B, const Analysis& A) {
             NumGcToStack++;
             
             Instruction* Begin = CS.getCaller()->getEntryBlock().begin();
-            return new AllocaInst(Ty, ".nongc_mem", Begin); // FIXME: align?
+            AllocaInst* alloca = new AllocaInst(Ty, ".nongc_mem", Begin);
+            alloca->setAlignment(GCAlignment);
+            return alloca;
         }
         
         FunctionInfo(unsigned typeInfoArgNr, bool safeToDelete)
         : TypeInfoArgNr(typeInfoArgNr), SafeToDelete(safeToDelete) {}
+
+        virtual ~FunctionInfo() {}
     };
     
     class ArrayFI : public FunctionInfo {
@@ -135,32 +162,46 @@ namespace {
                 return false;
             
             arrSize = CS.getArgument(ArrSizeArgNr);
-            const IntegerType* SizeType =
+            IntegerType* SizeType =
                 dyn_cast<IntegerType>(arrSize->getType());
             if (!SizeType)
                 return false;
-            unsigned bits = SizeType->getBitWidth();
-            if (bits > 32) {
-                // The array size of an alloca must be an i32, so make sure
-                // the conversion is safe.
-                APInt Mask = APInt::getHighBitsSet(bits, bits - 32);
-                APInt KnownZero(bits, 0), KnownOne(bits, 0);
-                ComputeMaskedBits(arrSize, Mask, KnownZero, KnownOne, &A.TD);
-                if ((KnownZero & Mask) != Mask)
-                    return false;
-            }
+
             // Extract the element type from the array type.
-            const StructType* ArrTy = dyn_cast<StructType>(Ty);
+            StructType* ArrTy = dyn_cast<StructType>(Ty);
             assert(ArrTy && "Dynamic array type not a struct?");
             assert(isa<IntegerType>(ArrTy->getElementType(0)));
-            const PointerType* PtrTy =
+            PointerType* PtrTy =
                 cast<PointerType>(ArrTy->getElementType(1));
             Ty = PtrTy->getElementType();
+
+            // Find an upper bound for the number of elements.
+            unsigned bits = SizeType->getBitWidth();
+            APInt Mask = APInt::getAllOnesValue(bits);
+            APInt KnownZero(bits, 0), KnownOne(bits, 0);
+            ComputeMaskedBits(arrSize, Mask, KnownZero, KnownOne, &A.TD);
+            APInt MaxCount = ~KnownZero;
+
+            // The array size of an alloca must be an i32, so make sure
+            // the conversion is safe.
+            if (MaxCount.getActiveBits() > 32)
+                return false;
+
+            uint64_t ElemSize = A.TD.getTypeAllocSize(Ty);
+            uint64_t Count = MaxCount.getZExtValue();
+            if (ElemSize != 0 && Count > SizeLimit / ElemSize)
+                MaxSize = ~0ULL;
+            else
+                MaxSize = Count * ElemSize;
             return true;
         }
         
-        virtual AllocaInst* promote(CallSite CS, IRBuilder<>& B, const Analysis& A) {
-            IRBuilder<> Builder = B;
+        virtual bool isDynamicSize() const {
+            return !isa<Constant>(arrSize);
+        }
+
+        virtual Value* promote(CallSite CS, IRBuilder<>& B, const Analysis& A) {
+            IRBuilder<> Builder(B.GetInsertBlock(), B.GetInsertPoint());
             // If the allocation is of constant size it's best to put it in the
             // entry block, so do so if we're not already there.
             // For dynamically-sized allocations it's best to avoid the overhead
@@ -177,7 +218,8 @@ namespace {
             
             // Convert array size to 32 bits if necessary
             Value* count = Builder.CreateIntCast(arrSize, Builder.getInt32Ty(), false);
-            AllocaInst* alloca = Builder.CreateAlloca(Ty, count, ".nongc_mem"); // FIXME: align?
+            AllocaInst* alloca = Builder.CreateAlloca(Ty, count, ".nongc_mem");
+            alloca->setAlignment(GCAlignment);
             
             if (Initialized) {
                 // For now, only zero-init is supported.
@@ -188,6 +230,14 @@ namespace {
                 Value* Size = B.CreateMul(TypeSize, arrSize);
                 EmitMemZero(B, alloca, Size, A);
             }
+
+            // D2 runtime functions return the new array as a slice.
+            if (StructType* SliceTy = dyn_cast<StructType>(CS.getType())) {
+                Value* ptr = B.CreateBitCast(alloca, SliceTy->getElementType(1));
+                Value* slice = UndefValue::get(SliceTy);
+                slice = B.CreateInsertValue(slice, arrSize, 0);
+                return B.CreateInsertValue(slice, ptr, 1, ".nongc_arr");
+            }
             
             return alloca;
         }
@@ -210,10 +260,10 @@ namespace {
             metaname += ClassInfo->getName();
 
             NamedMDNode* meta = A.M.getNamedMetadata(metaname);
-            if (!meta)
+            if (!meta || meta->getNumOperands() != 1)
                 return false;
 
-            MDNode* node = static_cast<MDNode*>(meta->getElement(0));
+            MDNode* node = meta->getOperand(0);
             if (!node || MD_GetNumElements(node) != CD_NumFields)
                 return false;
 
@@ -232,6 +282,7 @@ namespace {
                 return false;
             
             Ty = MD_GetElement(node, CD_BodyType)->getType();
+            MaxSize = A.TD.getTypeAllocSize(Ty);
             return true;
         }
         
@@ -239,6 +290,36 @@ namespace {
         
         AllocClassFI() : FunctionInfo(~0u, true) {}
     };
+
+    // FunctionInfo for _d_allocmemory, which the front end uses for closure
+    // frames and the copies of captured struct parameters (see DtoGcMalloc).
+    // It takes the size instead of a TypeInfo.
+    class AllocMemoryFI : public FunctionInfo {
+        public:
+        virtual bool analyze(CallSite CS, const Analysis& A) {
+            if (CS.arg_size() != 1)
+                return false;
+            ConstantInt* Size = dyn_cast<ConstantInt>(CS.getArgument(0));
+            if (!Size)
+                return false;
+            MaxSize = Size->getZExtValue();
+
+            // Allocate the type the result is cast to rather than bytes, so
+            // that the promoted frame can be split into registers later.
+            Instruction* Inst = CS.getInstruction();
+            Ty = NULL;
+            if (Inst->hasOneUse())
+                if (BitCastInst* BC = dyn_cast<BitCastInst>(*Inst->use_begin()))
+                    Ty = cast<PointerType>(BC->getType())->getElementType();
+            if (!Ty || !Ty->isSized() || A.TD.getTypeAllocSize(Ty) != MaxSize)
+                Ty = ArrayType::get(Type::getInt8Ty(A.M.getContext()), MaxSize);
+            return true;
+        }
+
+        // The default promote() should be fine.
+
+        AllocMemoryFI() : FunctionInfo(~0u, true) {}
+    };
 }
 
 
@@ -254,6 +335,7 @@ namespace {
         Module* M;
         
         FunctionInfo AllocMemoryT;
+        AllocMemoryFI AllocMemory;
         ArrayFI NewArrayVT;
         ArrayFI NewArrayT;
         AllocClassFI AllocClass;
@@ -272,9 +354,11 @@ namespace {
         virtual void getAnalysisUsage(AnalysisUsage &AU) const {
           AU.addRequired<TargetData>();
           AU.addRequired<DominatorTree>();
+          AU.addRequired<LoopInfo>();
           
           AU.addPreserved<CallGraph>();
           AU.addPreserved<DominatorTree>();
+          AU.addPreserved<LoopInfo>();
         }
     };
     char GarbageCollect2Stack::ID = 0;
@@ -289,12 +373,13 @@ FunctionPass *createGarbageCollect2Stack() {
 }
 
 GarbageCollect2Stack::GarbageCollect2Stack()
-: FunctionPass(&ID),
+: FunctionPass(ID),
   AllocMemoryT(0, true),
   NewArrayVT(0, true, false, 1),
   NewArrayT(0, true, true, 1)
 {
     KnownFunctions["_d_allocmemoryT"] = &AllocMemoryT;
+    KnownFunctions["_d_allocmemory"] = &AllocMemory;
     KnownFunctions["_d_newarrayvT"] = &NewArrayVT;
     KnownFunctions["_d_newarrayT"] = &NewArrayT;
     KnownFunctions[_d_allocclass] = &AllocClass;
@@ -319,6 +404,18 @@ static void RemoveCall(CallSite CS, const Analysis& A) {
 
 static bool isSafeToStackAllocate(Instruction* Alloc, DominatorTree& DT);
 
+/// Returns true if any block of L contains an alloca. Those would be released
+/// along with a promoted allocation when the stack is restored.
+static bool containsAlloca(Loop* L) {
+    for (Loop::block_iterator BI = L->block_begin(), BE = L->block_end();
+         BI != BE; ++BI) {
+        for (BasicBlock::iterator I = (*BI)->begin(), E = (*BI)->end(); I != E; ++I)
+            if (isa<AllocaInst>(I))
+                return true;
+    }
+    return false;
+}
+
 /// runOnFunction - Top level algorithm.
 ///
 bool GarbageCollect2Stack::runOnFunction(Function &F) {
@@ -326,21 +423,21 @@ bool GarbageCollect2Stack::runOnFunction(Function &F) {
     
     TargetData& TD = getAnalysis<TargetData>();
     DominatorTree& DT = getAnalysis<DominatorTree>();
+    LoopInfo& LI = getAnalysis<LoopInfo>();
     CallGraph* CG = getAnalysisIfAvailable<CallGraph>();
     CallGraphNode* CGNode = CG ? (*CG)[&F] : NULL;
     
     Analysis A = { TD, *M, CG, CGNode };
     
-    BasicBlock& Entry = F.getEntryBlock();
-    
-    IRBuilder<> AllocaBuilder(&Entry, Entry.begin());
+    // Bytes of stack used by the allocations promoted so far.
+    uint64_t FrameSize = 0;
     
     bool Changed = false;
     for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB) {
         for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ) {
             // Ignore non-calls.
             Instruction* Inst = I++;
-            CallSite CS = CallSite::get(Inst);
+            CallSite CS(Inst);
             if (!CS.getInstruction())
                 continue;
             
@@ -355,8 +452,8 @@ bool GarbageCollect2Stack::runOnFunction(Function &F) {
                 KnownFunctions.find(Callee->getName());
             if (OMI == KnownFunctions.end()) continue;
             
-            assert(isa<PointerType>(Inst->getType())
-                && "GC function doesn't return a pointer?");
+            assert((isa<PointerType>(Inst->getType()) || isa<StructType>(Inst->getType()))
+                && "GC function doesn't return a pointer or slice?");
             
             FunctionInfo* info = OMI->getValue();
             
@@ -369,13 +466,47 @@ bool GarbageCollect2Stack::runOnFunction(Function &F) {
             
             DEBUG(errs() << "GarbageCollect2Stack inspecting: " << *Inst);
             
-            if (!info->analyze(CS, A) || !isSafeToStackAllocate(Inst, DT))
+            if (!info->analyze(CS, A))
+                continue;
+
+            if (info->MaxSize > SizeLimit || FrameSize + info->MaxSize > FunctionSizeLimit) {
+                DEBUG(errs() << "Too large: " << info->MaxSize << " bytes\n");
+                NumTooLarge++;
                 continue;
+            }
+
+            if (!isSafeToStackAllocate(Inst, DT))
+                continue;
+
+            // A dynamically-sized alloca in a loop would grow the stack
+            // with every iteration. Release the previous iteration's memory
+            // by restoring the stack pointer saved before entering the loop;
+            // that is only correct if nothing else is allocated on the stack
+            // within the loop.
+            Value* SavedSP = NULL;
+            if (info->isDynamicSize()) {
+                if (Loop* L = LI.getLoopFor(BB)) {
+                    while (L->getParentLoop())
+                        L = L->getParentLoop();
+                    BasicBlock* Preheader = L->getLoopPreheader();
+                    if (!Preheader || containsAlloca(L))
+                        continue;
+
+                    IRBuilder<> PB(Preheader->getTerminator());
+                    SavedSP = PB.CreateCall(
+                        Intrinsic::getDeclaration(M, Intrinsic::stacksave), ".gc2stack_sp");
+                    NumInLoops++;
+                }
+            }
             
             // Let's alloca this!
             Changed = true;
+            FrameSize += info->MaxSize;
             
             IRBuilder<> Builder(BB, Inst);
+            if (SavedSP)
+                Builder.CreateCall(
+                    Intrinsic::getDeclaration(M, Intrinsic::stackrestore), SavedSP);
             Value* newVal = info->promote(CS, Builder, A);
             
             DEBUG(errs() << "Promoted to: " << *newVal);
@@ -393,7 +524,7 @@ bool GarbageCollect2Stack::runOnFunction(Function &F) {
     return Changed;
 }
 
-const Type* Analysis::getTypeFor(Value* typeinfo) const {
+Type* Analysis::getTypeFor(Value* typeinfo) const {
     GlobalVariable* ti_global = dyn_cast<GlobalVariable>(typeinfo->stripPointerCasts());
     if (!ti_global)
         return NULL;
@@ -402,10 +533,10 @@ const Type* Analysis::getTypeFor(Value* typeinfo) const {
     metaname += ti_global->getName();
 
     NamedMDNode* meta = M.getNamedMetadata(metaname);
-    if (!meta)
+    if (!meta || meta->getNumOperands() != 1)
         return NULL;
 
-    MDNode* node = static_cast<MDNode*>(meta->getElement(0));
+    MDNode* node = meta->getOperand(0);
     if (!node)
         return NULL;
 
@@ -563,7 +694,8 @@ static bool mayBeUsedAfterRealloc(Instruction* Def, Instruction* Alloc, Dominato
 /// Based on LLVM's PointerMayBeCaptured(), which only does escape analysis but
 /// doesn't care about loops.
 bool isSafeToStackAllocate(Instruction* Alloc, DominatorTree& DT) {
-  assert(isa<PointerType>(Alloc->getType()) && "Allocation is not a pointer?");
+  assert((isa<PointerType>(Alloc->getType()) || isa<StructType>(Alloc->getType()))
+      && "Allocation is not a pointer or slice?");
   Value* V = Alloc;
   
   SmallVector<Use*, 16> Worklist;
@@ -584,12 +716,11 @@ bool isSafeToStackAllocate(Instruction* Alloc, DominatorTree& DT) {
     switch (I->getOpcode()) {
     case Instruction::Call:
     case Instruction::Invoke: {
-      CallSite CS = CallSite::get(I);
+      CallSite CS(I);
       // Not captured if the callee is readonly, doesn't return a copy through
       // its return value and doesn't unwind (a readonly function can leak bits
       // by throwing an exception or not depending on the input value).
-      if (CS.onlyReadsMemory() && CS.doesNotThrow() &&
-          I->getType() == Type::getVoidTy(I->getContext()))
+      if (CS.onlyReadsMemory() && CS.doesNotThrow() && I->getType()->isVoidTy())
         break;
       
       // Not captured if only passed via 'nocapture' arguments.  Note that
@@ -608,22 +739,28 @@ bool isSafeToStackAllocate(Instruction* Alloc, DominatorTree& DT) {
       // captured.
       break;
     }
-    case Instruction::Free:
-      // Freeing a pointer does not cause it to be captured.
-      break;
     case Instruction::Load:
       // Loading from a pointer does not cause it to be captured.
       break;
+    case Instruction::ICmp:
+      // Comparing a pointer does not cause it to be captured.
+      break;
     case Instruction::Store:
       if (V == I->getOperand(0))
         // Stored the pointer - it may be captured.
         return false;
       // Storing to the pointee does not cause the pointer to be captured.
       break;
+    case Instruction::ExtractValue:
+      // The length of a slice is harmless, its pointer is a derived pointer.
+      if (!isa<PointerType>(I->getType()))
+        break;
+      // fallthrough
     case Instruction::BitCast:
     case Instruction::GetElementPtr:
     case Instruction::PHI:
     case Instruction::Select:
+    case Instruction::InsertValue:
       // It's not safe to stack-allocate if this derived pointer is live across
       // the original allocation.
       if (mayBeUsedAfterRealloc(I, Alloc, DT))
@@ -646,5 +783,3 @@ bool isSafeToStackAllocate(Instruction* Alloc, DominatorTree& DT) {
   // All uses examined - not captured or live across original allocation.
   return true;
 }
-
-#endif // USE_METADATA
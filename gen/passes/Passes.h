@@ -10,9 +10,15 @@ namespace llvm {
 // Performs simplifications on runtime calls.
 llvm::FunctionPass* createSimplifyDRuntimeCalls();
 
-#if USE_METADATA
+// Promotes GC allocations which don't escape to stack memory.
 llvm::FunctionPass* createGarbageCollect2Stack();
-#endif // USE_METADATA
+
+// Removes redundant array bounds checks.
+llvm::FunctionPass* createBoundsCheckElimination();
+
+// Calls the only known implementation of a virtual method directly if the
+// vtbl entry matches it.
+llvm::FunctionPass* createSpeculativeDevirtualization();
 
 llvm::ModulePass* createStripExternalsPass();
 
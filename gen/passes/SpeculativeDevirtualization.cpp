@@ -0,0 +1,179 @@
+//===- SpeculativeDevirtualization - Guard calls to likely vtbl targets ---===//
+//
+//                             The LLVM D Compiler
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// With -speculative-devirt, DtoVirtualFunctionPointer attaches "ldc.devirt"
+// metadata naming the only implementation of the method known in this
+// compilation to the load of a function pointer from a vtbl.
+//
+// This pass compares the loaded pointer with that implementation before each
+// call through it, and calls the implementation directly if they are equal,
+// so that it can be inlined. Instances of classes the compilation doesn't
+// know about still take the indirect call.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "ddevirt"
+
+#include "Passes.h"
+
+#include "llvm/Pass.h"
+#include "llvm/Module.h"
+#include "llvm/Constants.h"
+#include "llvm/Instructions.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+STATISTIC(NumGuarded, "Number of virtual calls guarded by a check of the vtbl entry");
+
+namespace {
+    /// A call through a function pointer loaded from a vtbl, and the function
+    /// the pointer most likely points to.
+    struct DevirtSite {
+        Instruction* Call;
+        LoadInst* Load;
+        Function* Target;
+    };
+
+    /// This pass calls the only known implementation of a virtual method
+    /// directly if the vtbl entry matches it.
+    class LLVM_LIBRARY_VISIBILITY SpeculativeDevirtualization : public FunctionPass {
+        unsigned DevirtKind;
+
+        bool getDevirtSite(Instruction* I, DevirtSite& Site);
+        void guard(const DevirtSite& Site);
+
+    public:
+        static char ID; // Pass identification
+        SpeculativeDevirtualization() : FunctionPass(ID) {}
+
+        bool runOnFunction(Function &F);
+    };
+    char SpeculativeDevirtualization::ID = 0;
+} // end anonymous namespace.
+
+static RegisterPass<SpeculativeDevirtualization>
+X("ddevirt", "Speculatively devirtualize calls of methods with a single implementation");
+
+// Public interface to the pass.
+FunctionPass *createSpeculativeDevirtualization() {
+  return new SpeculativeDevirtualization();
+}
+
+/// Returns true if I is an indirect call through a vtbl entry the front end
+/// annotated with its likely target.
+bool SpeculativeDevirtualization::getDevirtSite(Instruction* I, DevirtSite& Site) {
+    CallSite CS(I);
+    if (!CS.getInstruction() || CS.getCalledFunction())
+        return false;
+
+    LoadInst* Load = dyn_cast<LoadInst>(CS.getCalledValue()->stripPointerCasts());
+    if (!Load)
+        return false;
+    MDNode* MD = Load->getMetadata(DevirtKind);
+    if (!MD || MD->getNumOperands() != 1 || !MD->getOperand(0))
+        return false;
+    Function* Target = dyn_cast<Function>(MD->getOperand(0)->stripPointerCasts());
+    if (!Target)
+        return false;
+
+    Site.Call = I;
+    Site.Load = Load;
+    Site.Target = Target;
+    return true;
+}
+
+/// Turns
+///     r = call fp(args)
+/// into
+///     if (fp == Target) r1 = call Target(args) else r2 = call fp(args)
+///     r = phi [r1, r2]
+void SpeculativeDevirtualization::guard(const DevirtSite& Site) {
+    Instruction* Call = Site.Call;
+    BasicBlock* Head = Call->getParent();
+    Function* F = Head->getParent();
+    LLVMContext& Context = F->getContext();
+    DEBUG(errs() << "Guarding " << *Call << " with " << Site.Target->getName() << '\n');
+
+    Constant* Expected = ConstantExpr::getBitCast(Site.Target, Site.Load->getType());
+    Value* Cmp = new ICmpInst(Call, ICmpInst::ICMP_EQ, Site.Load, Expected, "devirt.cmp");
+
+    BasicBlock* Indirect = Head->splitBasicBlock(Call, "devirt.indirect");
+    BasicBlock* Direct = BasicBlock::Create(Context, "devirt.direct", F, Indirect);
+    Head->getTerminator()->eraseFromParent();
+    BranchInst::Create(Direct, Indirect, Cmp, Head);
+
+    Instruction* DirectCall = Call->clone();
+    if (Call->hasName())
+        DirectCall->setName(Call->getName() + ".devirt");
+    Direct->getInstList().push_back(DirectCall);
+    CallSite(DirectCall).setCalledFunction(
+        ConstantExpr::getBitCast(Site.Target, CallSite(Call).getCalledValue()->getType()));
+
+    BasicBlock* Merge;
+    if (InvokeInst* II = dyn_cast<InvokeInst>(Call)) {
+        // Both invokes continue in a new block that merges their results.
+        BasicBlock* Normal = II->getNormalDest();
+        Merge = BasicBlock::Create(Context, "devirt.merge", F, Normal);
+        BranchInst::Create(Normal, Merge);
+        for (BasicBlock::iterator I = Normal->begin(); PHINode* PN = dyn_cast<PHINode>(I); ++I)
+            PN->setIncomingBlock(PN->getBasicBlockIndex(Indirect), Merge);
+        II->setNormalDest(Merge);
+        cast<InvokeInst>(DirectCall)->setNormalDest(Merge);
+
+        // The landing pad is reached from the direct invoke as well.
+        BasicBlock* Unwind = II->getUnwindDest();
+        for (BasicBlock::iterator I = Unwind->begin(); PHINode* PN = dyn_cast<PHINode>(I); ++I)
+            PN->addIncoming(PN->getIncomingValueForBlock(Indirect), Direct);
+    } else {
+        BasicBlock::iterator Next = Call;
+        ++Next;
+        Merge = Indirect->splitBasicBlock(Next, "devirt.merge");
+        BranchInst::Create(Merge, Direct);
+    }
+
+    if (!Call->getType()->isVoidTy() && !Call->use_empty()) {
+        PHINode* PN = PHINode::Create(Call->getType(), 2, "devirt.result", Merge->begin());
+        Call->replaceAllUsesWith(PN);
+        PN->addIncoming(DirectCall, Direct);
+        PN->addIncoming(Call, Indirect);
+    }
+
+    NumGuarded++;
+}
+
+/// runOnFunction - Top level algorithm.
+///
+bool SpeculativeDevirtualization::runOnFunction(Function &F) {
+    DevirtKind = F.getContext().getMDKindID("ldc.devirt");
+
+    // Collect the calls first, guarding them splits their blocks.
+    SmallVector<DevirtSite, 16> Sites;
+    for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB) {
+        for (BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I) {
+            DevirtSite Site;
+            if (getDevirtSite(I, Site))
+                Sites.push_back(Site);
+        }
+    }
+
+    for (size_t i = 0; i < Sites.size(); i++)
+        guard(Sites[i]);
+
+    // Don't guard the remaining indirect calls again if the pass runs twice.
+    for (size_t i = 0; i < Sites.size(); i++)
+        Sites[i].Load->setMetadata(DevirtKind, NULL);
+
+    return !Sites.empty();
+}
@@ -119,6 +119,65 @@ llvm::GlobalVariable* LLVM_D_GetRuntimeGlobal(llvm::Module* target, const char*
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
+#if DMDV2
+
+// The associative arrays of druntime (rt/aaA.d) are laid out as
+//
+//   struct aaA { aaA* next; hash_t hash; /* key */ /* value */ }
+//   struct BB  { aaA*[] b; size_t nodes; TypeInfo keyti; }
+//   struct AA  { BB* a; }
+//
+// Each node stores the key right after its header and the value after the
+// key, whose size is rounded up by aligntsize(). The node for a key is found
+// in the list b[keyti.getHash(&key) % b.length].
+// DtoAAIndex and DtoAAIn inline lookups based on this, and DtoConstAALiteral
+// builds the tables of constant literals, so any change to the runtime layout
+// must be reflected here.
+
+LLStructType* LLVM_D_GetAANodeType()
+{
+    static LLStructType* nodeTy = NULL;
+    if (!nodeTy) {
+        nodeTy = LLStructType::create(gIR->context(), "aaA");
+        llvm::SmallVector<LLType*, 2> types;
+        types.push_back(getPtrToType(nodeTy));  // next
+        types.push_back(DtoSize_t());           // hash
+        nodeTy->setBody(types);
+    }
+    return nodeTy;
+}
+
+LLStructType* LLVM_D_GetAABucketsType()
+{
+    llvm::SmallVector<LLType*, 2> btypes;
+    btypes.push_back(DtoSize_t());
+    btypes.push_back(getPtrToType(getPtrToType(LLVM_D_GetAANodeType())));
+
+    llvm::SmallVector<LLType*, 3> types;
+    types.push_back(LLStructType::get(gIR->context(), btypes)); // b
+    types.push_back(DtoSize_t());                               // nodes
+    types.push_back(DtoType(Type::typeinfo->type));             // keyti
+    return LLStructType::get(gIR->context(), types);
+}
+
+size_t LLVM_D_GetAAKeyOffset()
+{
+    return getTypePaddedSize(LLVM_D_GetAANodeType());
+}
+
+size_t LLVM_D_GetAAValueOffset(Type* keytype)
+{
+    // aligntsize() pads keys to 16 bytes on 64 bit targets and to the
+    // pointer size otherwise
+    size_t keysize = getTypePaddedSize(DtoType(keytype));
+    size_t align = global.params.is64bit ? 16 : PTRSIZE;
+    return LLVM_D_GetAAKeyOffset() + ((keysize + align - 1) & ~(align - 1));
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
 static LLType* rt_ptr(LLType* t)
 {
     return getPtrToType(t);
@@ -223,6 +282,8 @@ static void LLVM_D_BuildRuntimeModule()
             = NoAttrs.addAttr(0, NoAlias),
         Attr_NoUnwind
             = NoAttrs.addAttr(~0U, NoUnwind),
+        Attr_NoReturn
+            = NoAttrs.addAttr(~0U, NoReturn),
         Attr_ReadOnly
             = NoAttrs.addAttr(~0U, ReadOnly),
         Attr_ReadOnly_NoUnwind
@@ -261,7 +322,8 @@ static void LLVM_D_BuildRuntimeModule()
         types.push_back(stringTy);
         types.push_back(intTy);
         LLFunctionType* fty = llvm::FunctionType::get(voidTy, types, false);
-        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M);
+        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M)
+            ->setAttributes(Attr_NoReturn);
     }
 
     // D1:
@@ -281,8 +343,10 @@ static void LLVM_D_BuildRuntimeModule()
 #endif
         types.push_back(intTy);
         LLFunctionType* fty = llvm::FunctionType::get(voidTy, types, false);
-        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M);
-        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname2, M);
+        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M)
+            ->setAttributes(Attr_NoReturn);
+        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname2, M)
+            ->setAttributes(Attr_NoReturn);
     }
 
     // void _d_assert_msg( char[] msg, char[] file, uint line )
@@ -293,7 +357,8 @@ static void LLVM_D_BuildRuntimeModule()
         types.push_back(stringTy);
         types.push_back(intTy);
         LLFunctionType* fty = llvm::FunctionType::get(voidPtrTy, types, false);
-        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M);
+        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M)
+            ->setAttributes(Attr_NoReturn);
     }
 
     /////////////////////////////////////////////////////////////////////////////////////
@@ -430,6 +495,16 @@ static void LLVM_D_BuildRuntimeModule()
         LLFunctionType* fty = llvm::FunctionType::get(voidArrayTy, types, false);
         llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M);
     }
+    // size_t _d_arraysetcapacity(TypeInfo ti, size_t newcapacity, void[]* p)
+    {
+        llvm::StringRef fname("_d_arraysetcapacity");
+        std::vector<LLType*> types;
+        types.push_back(typeInfoTy);
+        types.push_back(sizeTy);
+        types.push_back(voidArrayPtrTy);
+        LLFunctionType* fty = llvm::FunctionType::get(sizeTy, types, false);
+        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M);
+    }
     // void[] _d_arrayappendcd(ref char[] x, dchar c)
     {
         llvm::StringRef fname("_d_arrayappendcd");
@@ -1010,7 +1085,8 @@ static void LLVM_D_BuildRuntimeModule()
         std::vector<LLType*> types;
         types.push_back(objectTy);
         LLFunctionType* fty = llvm::FunctionType::get(voidTy, types, false);
-        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M);
+        llvm::Function::Create(fty, llvm::GlobalValue::ExternalLinkage, fname, M)
+            ->setAttributes(Attr_NoReturn);
     }
 
     /////////////////////////////////////////////////////////////////////////////////////
@@ -10,6 +10,17 @@ llvm::Function* LLVM_D_GetRuntimeFunction(llvm::Module* target, const char* name
 
 llvm::GlobalVariable* LLVM_D_GetRuntimeGlobal(llvm::Module* target, const char* name);
 
+#if DMDV2
+struct Type;
+
+// Layout of druntime's associative arrays (rt/aaA.d), used to inline lookups.
+// Must be kept in sync with the runtime, see runtime.cpp.
+llvm::StructType* LLVM_D_GetAANodeType();
+llvm::StructType* LLVM_D_GetAABucketsType();
+size_t LLVM_D_GetAAKeyOffset();
+size_t LLVM_D_GetAAValueOffset(Type* keytype);
+#endif
+
 #if DMDV1
 #define _d_allocclass "_d_allocclass"
 #define _adEq "_adEq"
@@ -3,10 +3,13 @@
 #include <stdio.h>
 #include <math.h>
 #include <fstream>
+#include <map>
+#include <set>
 
 #include "gen/llvm.h"
 #include "llvm/InlineAsm.h"
 #include "llvm/Support/CFG.h"
+#include "llvm/ADT/StringExtras.h"
 
 #include "mars.h"
 #include "init.h"
@@ -31,6 +34,34 @@
 
 //////////////////////////////////////////////////////////////////////////////
 
+#if DMDV2
+// Returns s as an append of a single element to an array variable if the
+// element can be evaluated before earlier appends to the array without
+// changing its value.
+static CatAssignExp* isElementAppend(Statement* s)
+{
+    ExpStatement* es = s ? s->isExpStatement() : NULL;
+    if (!es || !es->exp || es->exp->op != TOKcatass)
+        return NULL;
+
+    CatAssignExp* ce = static_cast<CatAssignExp*>(es->exp);
+    if (ce->e1->op != TOKvar || !((VarExp*)ce->e1)->var->isVarDeclaration())
+        return NULL;
+    Type* arrayType = ce->e1->type->toBasetype();
+    if (arrayType->ty != Tarray || ce->e2->type->toBasetype() != arrayType->nextOf()->toBasetype())
+        return NULL;
+
+    Expression* e = ce->e2;
+    if (e->isConst() || e->op == TOKstring)
+        return ce;
+    // an element variable can't be the array, and appending doesn't
+    // change existing elements it might refer to
+    if (e->op == TOKvar && ((VarExp*)e)->var->isVarDeclaration())
+        return ce;
+    return NULL;
+}
+#endif
+
 void CompoundStatement::toIR(IRState* p)
 {
     Logger::println("CompoundStatement::toIR(): %s", loc.toChars());
@@ -39,9 +70,35 @@ void CompoundStatement::toIR(IRState* p)
     for (unsigned i=0; i<statements->dim; i++)
     {
         Statement* s = (Statement*)statements->data[i];
-        if (s) {
-            s->toIR(p);
+        if (!s)
+            continue;
+
+#if DMDV2
+        // grow the array once for a run of appends to it
+        if (CatAssignExp* ce = isElementAppend(s))
+        {
+            Declaration* var = ((VarExp*)ce->e1)->var;
+            std::vector<Expression*> elems(1, ce->e2);
+            unsigned j = i + 1;
+            for (; j < statements->dim; j++)
+            {
+                CatAssignExp* next = isElementAppend((Statement*)statements->data[j]);
+                if (!next || ((VarExp*)next->e1)->var != var)
+                    break;
+                elems.push_back(next->e2);
+            }
+            if (elems.size() > 1)
+            {
+                Logger::println("fusing %zu appends to %s", elems.size(), var->toChars());
+                DtoDwarfStopPoint(s->loc.linnum);
+                DtoCatAssignElements(ce->loc, ce->e1->type->toBasetype(), ce->e1->toElem(p), elems);
+                i = j - 1;
+                continue;
+            }
         }
+#endif
+
+        s->toIR(p);
     }
 }
 
@@ -427,6 +484,287 @@ void DoStatement::toIR(IRState* p)
 
 //////////////////////////////////////////////////////////////////////////////
 
+#if DMDV2
+// how an array variable is used in a loop
+struct LoopArrayUse
+{
+    Expression* array;      // the array in the first append
+    unsigned uses;          // all references to the variable
+    unsigned appends;       // ~= to it
+    unsigned elemAppends;   // ~= of a single element done in every iteration
+    bool unconditional;     // some element append is done in every iteration
+    bool local;             // declared in the loop
+    bool written;           // assigned, incremented or address taken
+
+    LoopArrayUse() : array(NULL), uses(0), appends(0), elemAppends(0),
+        unconditional(false), local(false), written(false) {}
+};
+
+struct LoopAppendScan
+{
+    std::map<VarDeclaration*, LoopArrayUse> vars;
+    bool conditional;       // in the body of an if statement
+
+    LoopAppendScan() : conditional(false) {}
+};
+
+// returns the variable an element is appended to by e, or NULL
+static VarDeclaration* elementAppendVar(Expression* e)
+{
+    if (e->op != TOKcatass)
+        return NULL;
+    CatAssignExp* ce = static_cast<CatAssignExp*>(e);
+    if (ce->e1->op != TOKvar)
+        return NULL;
+    Type* arrayType = ce->e1->type->toBasetype();
+    if (arrayType->ty != Tarray || ce->e2->type->toBasetype() != arrayType->nextOf()->toBasetype())
+        return NULL;
+    return ((VarExp*)ce->e1)->var->isVarDeclaration();
+}
+
+// marks the variable e, or the length of which e is, as written
+static void markLoopWrite(LoopAppendScan& scan, Expression* e)
+{
+    if (e->op == TOKarraylength)
+        e = ((ArrayLengthExp*)e)->e1;
+    if (e->op == TOKvar)
+        if (VarDeclaration* vd = ((VarExp*)e)->var->isVarDeclaration())
+            scan.vars[vd].written = true;
+}
+
+static int scanLoopAppendsExp(Expression* e, void* param)
+{
+    LoopAppendScan& scan = *(LoopAppendScan*)param;
+    switch (e->op)
+    {
+    case TOKvar:
+        if (VarDeclaration* vd = ((VarExp*)e)->var->isVarDeclaration())
+            scan.vars[vd].uses++;
+        break;
+
+    case TOKcatass: {
+        CatAssignExp* ce = static_cast<CatAssignExp*>(e);
+        markLoopWrite(scan, ce->e1);
+        if (ce->e1->op == TOKvar && ((VarExp*)ce->e1)->var->isVarDeclaration())
+            scan.vars[((VarExp*)ce->e1)->var->isVarDeclaration()].appends++;
+        break;
+    }
+
+    case TOKassign: case TOKconstruct: case TOKblit:
+    case TOKaddass: case TOKminass: case TOKmulass: case TOKdivass:
+    case TOKmodass: case TOKandass: case TOKorass: case TOKxorass:
+    case TOKshlass: case TOKshrass: case TOKushrass: case TOKpowass:
+    case TOKplusplus: case TOKminusminus:
+        markLoopWrite(scan, ((BinExp*)e)->e1);
+        break;
+
+    case TOKpreplusplus: case TOKpreminusminus: case TOKaddress:
+        markLoopWrite(scan, ((UnaExp*)e)->e1);
+        break;
+
+    case TOKcall: {
+        // arguments passed by reference can be written by the callee
+        CallExp* ce = static_cast<CallExp*>(e);
+        Type* t = ce->e1->type->toBasetype();
+        if (t->ty == Tdelegate || t->ty == Tpointer)
+            t = t->nextOf()->toBasetype();
+        TypeFunction* tf = t->ty == Tfunction ? (TypeFunction*)t : NULL;
+        size_t nparams = tf ? Parameter::dim(tf->parameters) : 0;
+        for (size_t i = 0; ce->arguments && i < ce->arguments->dim; i++)
+        {
+            Parameter* fnarg = i < nparams ? Parameter::getNth(tf->parameters, i) : NULL;
+            if (!tf || (fnarg && (fnarg->storageClass & (STCref | STCout))))
+                markLoopWrite(scan, (Expression*)ce->arguments->data[i]);
+        }
+        break;
+    }
+
+    case TOKdeclaration: {
+        // nested functions could change the arrays
+        VarDeclaration* vd = ((DeclarationExp*)e)->declaration->isVarDeclaration();
+        if (!vd)
+            return 1;
+        scan.vars[vd].local = true;
+        if (vd->init && !vd->init->isVoidInitializer()) {
+            ExpInitializer* ie = vd->init->isExpInitializer();
+            if (!ie)
+                return 1;
+            return ie->exp->apply(&scanLoopAppendsExp, param);
+        }
+        break;
+    }
+
+    case TOKfunction:
+        return 1;
+
+    default:
+        break;
+    }
+    return 0;
+}
+
+// collects the uses of variables in s. Returns false if s contains anything
+// but expressions, compound statements and if statements.
+static bool scanLoopAppends(Statement* s, LoopAppendScan& scan)
+{
+    if (!s)
+        return true;
+
+    if (ExpStatement* es = s->isExpStatement()) {
+        if (!es->exp)
+            return true;
+        if (es->exp->apply(&scanLoopAppendsExp, &scan))
+            return false;
+        VarDeclaration* vd = elementAppendVar(es->exp);
+        if (vd && !scan.conditional) {
+            LoopArrayUse& use = scan.vars[vd];
+            use.unconditional = true;
+            use.elemAppends++;
+            if (!use.array)
+                use.array = ((CatAssignExp*)es->exp)->e1;
+        }
+        return true;
+    }
+
+    if (CompoundStatement* cs = s->isCompoundStatement()) {
+        for (unsigned i = 0; i < cs->statements->dim; i++)
+            if (!scanLoopAppends((Statement*)cs->statements->data[i], scan))
+                return false;
+        return true;
+    }
+
+    if (ScopeStatement* ss = s->isScopeStatement())
+        return scanLoopAppends(ss->statement, scan);
+
+    if (IfStatement* is = s->isIfStatement()) {
+        if (is->condition->apply(&scanLoopAppendsExp, &scan))
+            return false;
+        bool conditional = scan.conditional;
+        scan.conditional = true;
+        bool ok = scanLoopAppends(is->ifbody, scan) && scanLoopAppends(is->elsebody, scan);
+        scan.conditional = conditional;
+        return ok;
+    }
+
+    return false;
+}
+
+static Expression* stripIntegralCasts(Expression* e)
+{
+    while (e->op == TOKcast && e->type->isintegral())
+        e = ((CastExp*)e)->e1;
+    return e;
+}
+
+// the loop can't change v behind the back of the scan
+static bool isLoopInvariantVar(LoopAppendScan& scan, Declaration* v)
+{
+    VarDeclaration* vd = v->isVarDeclaration();
+    if (!vd || vd->isDataseg() || vd->nestedrefs.dim ||
+        (vd->storage_class & (STCref | STCout | STClazy)))
+        return false;
+    std::map<VarDeclaration*, LoopArrayUse>::iterator it = scan.vars.find(vd);
+    return it == scan.vars.end() || !it->second.written;
+}
+
+// if fs has the form for (...; key < bound; ++key) with a variable or
+// constant bound that neither the condition nor the body scanned into scan
+// writes, returns the number of iterations as computed before the first
+// one. Otherwise returns NULL.
+static LLValue* DtoForTripCount(IRState* p, ForStatement* fs, LoopAppendScan& scan)
+{
+    if (!fs->condition || fs->condition->op != TOKlt || !fs->increment)
+        return NULL;
+    CmpExp* cmp = static_cast<CmpExp*>(fs->condition);
+    if (!cmp->e1->type->isintegral())
+        return NULL;
+
+    Expression* key = stripIntegralCasts(cmp->e1);
+    if (key->op != TOKvar || !key->type->isintegral())
+        return NULL;
+    Declaration* keyvar = ((VarExp*)key)->var;
+    if (!isLoopInvariantVar(scan, keyvar))
+        return NULL;
+
+    Expression* bound = stripIntegralCasts(cmp->e2);
+    if (bound->op == TOKarraylength)
+        bound = ((ArrayLengthExp*)bound)->e1;
+    if (bound->op == TOKvar) {
+        if (!isLoopInvariantVar(scan, ((VarExp*)bound)->var))
+            return NULL;
+    } else if (bound->op != TOKint64) {
+        return NULL;
+    }
+
+    // key += 1, key++ or ++key
+    Expression* inc = fs->increment;
+    Expression* incvar;
+    if (inc->op == TOKaddass) {
+        Expression* step = stripIntegralCasts(((BinExp*)inc)->e2);
+        if (!step->isConst() || step->toInteger() != 1)
+            return NULL;
+        incvar = ((BinExp*)inc)->e1;
+    } else if (inc->op == TOKplusplus) {
+        incvar = ((BinExp*)inc)->e1;
+    } else if (inc->op == TOKpreplusplus) {
+        incvar = ((UnaExp*)inc)->e1;
+    } else {
+        return NULL;
+    }
+    if (incvar->op != TOKvar || ((VarExp*)incvar)->var != keyvar)
+        return NULL;
+
+    if (getTypeBitSize(DtoType(cmp->e1->type)) > getTypeBitSize(DtoSize_t()))
+        return NULL;
+
+    LLValue* keyval = cmp->e1->toElem(p)->getRVal();
+    LLValue* boundval = cmp->e2->toElem(p)->getRVal();
+
+    LLValue* more = cmp->e1->type->isunsigned()
+        ? p->ir->CreateICmpUGT(boundval, keyval)
+        : p->ir->CreateICmpSGT(boundval, keyval);
+    // the difference fits into the unsigned type of the same size
+    LLValue* trip = p->ir->CreateZExtOrBitCast(p->ir->CreateSub(boundval, keyval), DtoSize_t());
+    return p->ir->CreateSelect(more, trip, DtoConstSize_t(0), "fortrip");
+}
+
+// Reserves room in the arrays the body of a counted loop appends elements
+// to, so that they don't have to be grown in each iteration. Only arrays
+// that are used for nothing but ~= in the loop, with an element appended in
+// every iteration, are considered.
+static void DtoReserveLoopAppends(IRState* p, ForStatement* fs)
+{
+    LoopAppendScan scan;
+    if (!fs->body || !scanLoopAppends(fs->body, scan))
+        return;
+    if (fs->condition && fs->condition->apply(&scanLoopAppendsExp, &scan))
+        return;
+    // DtoForTripCount only accepts an increment of the key, which touches
+    // none of the arrays
+
+    // the reservation is for a loop that runs to its end
+    if (fs->body->blockExit(false) & (BEbreak | BEgoto | BEreturn | BEhalt | BEthrow))
+        return;
+
+    LLValue* trip = NULL;
+    std::map<VarDeclaration*, LoopArrayUse>::iterator it, end = scan.vars.end();
+    for (it = scan.vars.begin(); it != end; ++it)
+    {
+        VarDeclaration* vd = it->first;
+        LoopArrayUse& use = it->second;
+        if (!use.unconditional || use.local || use.uses != use.appends ||
+            (vd->storage_class & STClazy))
+            continue;
+
+        if (!trip && !(trip = DtoForTripCount(p, fs, scan)))
+            return;
+
+        Logger::println("reserving room for %u appends per iteration to %s", use.elemAppends, vd->toChars());
+        DtoReserveAppends(use.array->toElem(p), trip, use.elemAppends);
+    }
+}
+#endif
+
 void ForStatement::toIR(IRState* p)
 {
     Logger::println("ForStatement::toIR(): %s", loc.toChars());
@@ -446,6 +784,10 @@ void ForStatement::toIR(IRState* p)
     if (init != 0)
         init->toIR(p);
 
+#if DMDV2
+    DtoReserveLoopAppends(p, this);
+#endif
+
     // move into the for condition block, ie. start the loop
     assert(!gIR->scopereturned());
     llvm::BranchInst::Create(forbb, gIR->scopebb());
@@ -858,6 +1200,327 @@ static LLValue* call_string_switch_runtime(llvm::Value* table, Expression* e)
     return call.getInstruction();
 }
 
+// switches on non-constant case values with at least this many cases
+// dispatch using a sorted snapshot of the case values
+static const unsigned minSwitchTableCases = 8;
+
+// returns a function sorting the {value, case index} entries of a switch table
+// by value (using insertion sort), creating it if necessary
+static llvm::Function* getSwitchTableSortFn(LLStructType* entryTy, bool isSigned)
+{
+    llvm::IntegerType* valTy = llvm::cast<llvm::IntegerType>(entryTy->getElementType(0));
+    std::string name = isSigned ? "ldc.switchtable.sort.i" : "ldc.switchtable.sort.u";
+    name += llvm::utostr(valTy->getBitWidth());
+    if (llvm::Function* fn = gIR->module->getFunction(name))
+        return fn;
+
+    std::vector<LLType*> params;
+    params.push_back(getPtrToType(entryTy));
+    params.push_back(DtoSize_t());
+    LLFunctionType* fty = LLFunctionType::get(LLType::getVoidTy(gIR->context()), params, false);
+    llvm::Function* fn = llvm::Function::Create(fty, llvm::GlobalValue::InternalLinkage, name, gIR->module);
+    fn->setDoesNotThrow();
+
+    llvm::Function::arg_iterator args = fn->arg_begin();
+    LLValue* table = args++;
+    LLValue* n = args;
+    LLValue* zero = DtoConstSize_t(0);
+    LLValue* one = DtoConstSize_t(1);
+
+    llvm::LLVMContext& ctx = gIR->context();
+    llvm::BasicBlock* entrybb = llvm::BasicBlock::Create(ctx, "entry", fn);
+    llvm::BasicBlock* outerbb = llvm::BasicBlock::Create(ctx, "outer", fn);
+    llvm::BasicBlock* bodybb = llvm::BasicBlock::Create(ctx, "body", fn);
+    llvm::BasicBlock* innerbb = llvm::BasicBlock::Create(ctx, "inner", fn);
+    llvm::BasicBlock* cmpbb = llvm::BasicBlock::Create(ctx, "cmp", fn);
+    llvm::BasicBlock* shiftbb = llvm::BasicBlock::Create(ctx, "shift", fn);
+    llvm::BasicBlock* placebb = llvm::BasicBlock::Create(ctx, "place", fn);
+    llvm::BasicBlock* exitbb = llvm::BasicBlock::Create(ctx, "exit", fn);
+
+    IRBuilder<> b(entrybb);
+    b.CreateBr(outerbb);
+
+    // for (i = 1; i < n; ++i)
+    b.SetInsertPoint(outerbb);
+    llvm::PHINode* i = b.CreatePHI(DtoSize_t(), 2, "i");
+    i->addIncoming(one, entrybb);
+    b.CreateCondBr(b.CreateICmpULT(i, n), bodybb, exitbb);
+
+    b.SetInsertPoint(bodybb);
+    LLValue* key = b.CreateLoad(b.CreateGEP(table, i), "key");
+    LLValue* keyval = b.CreateExtractValue(key, 0);
+    b.CreateBr(innerbb);
+
+    // for (j = i; j > 0 && table[j-1] > key; --j) table[j] = table[j-1];
+    b.SetInsertPoint(innerbb);
+    llvm::PHINode* j = b.CreatePHI(DtoSize_t(), 2, "j");
+    j->addIncoming(i, bodybb);
+    b.CreateCondBr(b.CreateICmpEQ(j, zero), placebb, cmpbb);
+
+    b.SetInsertPoint(cmpbb);
+    LLValue* jprev = b.CreateSub(j, one);
+    LLValue* prev = b.CreateLoad(b.CreateGEP(table, jprev), "prev");
+    LLValue* prevval = b.CreateExtractValue(prev, 0);
+    LLValue* gt = isSigned ? b.CreateICmpSGT(prevval, keyval) : b.CreateICmpUGT(prevval, keyval);
+    b.CreateCondBr(gt, shiftbb, placebb);
+
+    b.SetInsertPoint(shiftbb);
+    b.CreateStore(prev, b.CreateGEP(table, j));
+    j->addIncoming(jprev, shiftbb);
+    b.CreateBr(innerbb);
+
+    // table[j] = key
+    b.SetInsertPoint(placebb);
+    b.CreateStore(key, b.CreateGEP(table, j));
+    i->addIncoming(b.CreateAdd(i, one), placebb);
+    b.CreateBr(outerbb);
+
+    b.SetInsertPoint(exitbb);
+    b.CreateRetVoid();
+
+    return fn;
+}
+
+// returns a function doing a binary search for a value in a sorted switch
+// table, creating it if necessary. It returns the case index of the first
+// matching entry, or -1 if there is none. The table is sorted stably, so that
+// is the lowest case index with that value, as with a chain of compares.
+static llvm::Function* getSwitchTableFindFn(LLStructType* entryTy, bool isSigned)
+{
+    llvm::IntegerType* valTy = llvm::cast<llvm::IntegerType>(entryTy->getElementType(0));
+    llvm::IntegerType* idxTy = llvm::cast<llvm::IntegerType>(entryTy->getElementType(1));
+    std::string name = isSigned ? "ldc.switchtable.find.i" : "ldc.switchtable.find.u";
+    name += llvm::utostr(valTy->getBitWidth());
+    if (llvm::Function* fn = gIR->module->getFunction(name))
+        return fn;
+
+    std::vector<LLType*> params;
+    params.push_back(getPtrToType(entryTy));
+    params.push_back(DtoSize_t());
+    params.push_back(valTy);
+    LLFunctionType* fty = LLFunctionType::get(idxTy, params, false);
+    llvm::Function* fn = llvm::Function::Create(fty, llvm::GlobalValue::InternalLinkage, name, gIR->module);
+    fn->setDoesNotThrow();
+    fn->setOnlyReadsMemory();
+
+    llvm::Function::arg_iterator args = fn->arg_begin();
+    LLValue* table = args++;
+    LLValue* n = args++;
+    LLValue* key = args;
+
+    llvm::LLVMContext& ctx = gIR->context();
+    llvm::BasicBlock* entrybb = llvm::BasicBlock::Create(ctx, "entry", fn);
+    llvm::BasicBlock* loopbb = llvm::BasicBlock::Create(ctx, "loop", fn);
+    llvm::BasicBlock* bodybb = llvm::BasicBlock::Create(ctx, "body", fn);
+    llvm::BasicBlock* checkbb = llvm::BasicBlock::Create(ctx, "check", fn);
+    llvm::BasicBlock* cmpbb = llvm::BasicBlock::Create(ctx, "cmp", fn);
+    llvm::BasicBlock* foundbb = llvm::BasicBlock::Create(ctx, "found", fn);
+    llvm::BasicBlock* notfoundbb = llvm::BasicBlock::Create(ctx, "notfound", fn);
+
+    IRBuilder<> b(entrybb);
+    b.CreateBr(loopbb);
+
+    // find the first entry not less than key: while (lo < hi)
+    b.SetInsertPoint(loopbb);
+    llvm::PHINode* lo = b.CreatePHI(DtoSize_t(), 2, "lo");
+    llvm::PHINode* hi = b.CreatePHI(DtoSize_t(), 2, "hi");
+    lo->addIncoming(DtoConstSize_t(0), entrybb);
+    hi->addIncoming(n, entrybb);
+    b.CreateCondBr(b.CreateICmpULT(lo, hi), bodybb, checkbb);
+
+    b.SetInsertPoint(bodybb);
+    LLValue* mid = b.CreateLShr(b.CreateAdd(lo, hi), DtoConstSize_t(1), "mid");
+    LLValue* val = b.CreateExtractValue(b.CreateLoad(b.CreateGEP(table, mid), "entry"), 0);
+    LLValue* lt = isSigned ? b.CreateICmpSLT(val, key) : b.CreateICmpULT(val, key);
+    lo->addIncoming(b.CreateSelect(lt, b.CreateAdd(mid, DtoConstSize_t(1)), lo), bodybb);
+    hi->addIncoming(b.CreateSelect(lt, hi, mid), bodybb);
+    b.CreateBr(loopbb);
+
+    // if (lo < n && table[lo].val == key) return table[lo].idx
+    b.SetInsertPoint(checkbb);
+    b.CreateCondBr(b.CreateICmpULT(lo, n), cmpbb, notfoundbb);
+
+    b.SetInsertPoint(cmpbb);
+    LLValue* entry = b.CreateLoad(b.CreateGEP(table, lo), "entry");
+    b.CreateCondBr(b.CreateICmpEQ(b.CreateExtractValue(entry, 0), key), foundbb, notfoundbb);
+
+    b.SetInsertPoint(foundbb);
+    b.CreateRet(b.CreateExtractValue(entry, 1));
+
+    b.SetInsertPoint(notfoundbb);
+    b.CreateRet(llvm::ConstantInt::get(idxTy, -1, true));
+
+    return fn;
+}
+
+// dispatches a switch on non-constant case values using a binary search on a
+// sorted thread-local snapshot of the case values. The values are computed in
+// tablebb..tableendbb, which is only executed if there is no snapshot yet.
+// Note that the snapshot is taken the first time the switch runs in a thread:
+// if that happens before the static constructor that initializes the case
+// values, the switch keeps using the values seen at that time.
+static void emitSwitchTableLookup(IRState* p, CaseStatements* cases, LLValue* condVal, bool isSigned,
+    llvm::BasicBlock* tablebb, llvm::BasicBlock* tableendbb, llvm::BasicBlock* defbb, bool coldDefault,
+    llvm::BasicBlock* oldend)
+{
+    size_t n = cases->dim;
+    LLType* idxTy = LLType::getInt32Ty(gIR->context());
+    std::vector<LLType*> types;
+    types.push_back(condVal->getType());
+    types.push_back(idxTy);
+    LLStructType* entryTy = llvm::StructType::get(gIR->context(), types);
+    LLArrayType* tableTy = llvm::ArrayType::get(entryTy, n);
+
+    LLGlobalVariable* table = new llvm::GlobalVariable(*gIR->module, tableTy, false,
+        llvm::GlobalValue::InternalLinkage, llvm::Constant::getNullValue(tableTy),
+        ".switch_table", 0, true);
+    LLGlobalVariable* ready = new llvm::GlobalVariable(*gIR->module, LLType::getInt1Ty(gIR->context()), false,
+        llvm::GlobalValue::InternalLinkage, LLConstantInt::getFalse(gIR->context()),
+        ".switch_table_ready", 0, true);
+
+    llvm::BasicBlock* lookupbb = llvm::BasicBlock::Create(gIR->context(), "switchlookup", p->topfunc(), oldend);
+    llvm::BranchInst::Create(lookupbb, tablebb, DtoLoad(ready), p->scopebb());
+
+    // fill and sort the snapshot
+    p->scope() = IRScope(tableendbb, oldend);
+    for (unsigned i=0; i<n; ++i)
+    {
+        CaseStatement* cs = (CaseStatement*)cases->data[i];
+        LLValue* entry = DtoGEPi(table, 0, i);
+        DtoStore(cs->llvmIdx, DtoGEPi(entry, 0, 0));
+        DtoStore(LLConstantInt::get(idxTy, i), DtoGEPi(entry, 0, 1));
+    }
+    LLValue* tableptr = DtoGEPi(table, 0, 0);
+    p->ir->CreateCall2(getSwitchTableSortFn(entryTy, isSigned), tableptr, DtoConstSize_t(n));
+    DtoStore(LLConstantInt::getTrue(gIR->context()), ready);
+    llvm::BranchInst::Create(lookupbb, p->scopebb());
+
+    // look up the case index and dispatch on it
+    p->scope() = IRScope(lookupbb, oldend);
+    LLValue* idx = p->ir->CreateCall3(getSwitchTableFindFn(entryTy, isSigned),
+        tableptr, DtoConstSize_t(n), condVal, "switchidx");
+    llvm::SwitchInst* si = llvm::SwitchInst::Create(idx, defbb, n, p->scopebb());
+    for (unsigned i=0; i<n; ++i)
+    {
+        CaseStatement* cs = (CaseStatement*)cases->data[i];
+        si->addCase(llvm::cast<llvm::ConstantInt>(LLConstantInt::get(idxTy, i)), cs->bodyBB);
+    }
+    if (coldDefault)
+        DtoSetColdDefault(si);
+}
+
+// string switches with more cases than this are still lowered to a call to
+// _d_switch_string, to keep the size of the generated code in check
+static const unsigned maxInlineStringSwitchCases = 256;
+
+// a case of an inlined string switch
+struct StringSwitchCase
+{
+    StringExp* str;
+    llvm::BasicBlock* target;
+
+    StringSwitchCase(StringExp* s, llvm::BasicBlock* bb) : str(s), target(bb) {}
+};
+
+typedef std::vector<StringSwitchCase> StringSwitchCases;
+
+// emits a decision tree dispatching on the characters of a string whose length
+// is known to equal the length of all the given (distinct) case strings, ending
+// in a single memcmp against the only candidate left. If coldDefault is set,
+// the branches to defbb are marked as unlikely.
+static void emitStringSwitchTree(IRState* p, const StringSwitchCases& cases,
+    LLValue* ptr, llvm::BasicBlock* defbb, bool coldDefault, llvm::BasicBlock* oldend)
+{
+    assert(!cases.empty());
+    size_t len = cases[0].str->len;
+
+    if (cases.size() == 1)
+    {
+        const StringSwitchCase& c = cases[0];
+        if (len == 0) {
+            llvm::BranchInst::Create(c.target, p->scopebb());
+            return;
+        }
+        LLConstant* str = c.str->toConstElem(p);
+        LLConstant* strptr = llvm::ConstantExpr::getExtractValue(str, llvm::makeArrayRef(1u));
+        LLValue* nbytes = DtoConstSize_t(len * c.str->sz);
+        LLValue* cmp = DtoMemCmp(ptr, strptr, nbytes);
+        cmp = p->ir->CreateICmpEQ(cmp, DtoConstInt(0), "strswitchcmp");
+        if (coldDefault)
+            DtoCondBrCold(cmp, c.target, defbb);
+        else
+            llvm::BranchInst::Create(c.target, defbb, cmp, p->scopebb());
+        return;
+    }
+
+    // find the position that splits the cases into the most groups,
+    // preferring earlier positions
+    size_t bestpos = 0;
+    size_t bestcount = 0;
+    for (size_t pos = 0; pos < len; ++pos)
+    {
+        std::set<unsigned> chars;
+        for (size_t i = 0; i < cases.size(); ++i)
+            chars.insert(cases[i].str->charAt(pos));
+        if (chars.size() > bestcount) {
+            bestpos = pos;
+            bestcount = chars.size();
+        }
+    }
+    assert(bestcount > 1 && "duplicate case strings");
+
+    std::map<unsigned, StringSwitchCases> groups;
+    for (size_t i = 0; i < cases.size(); ++i)
+        groups[cases[i].str->charAt(bestpos)].push_back(cases[i]);
+
+    LLValue* c = DtoLoad(DtoGEPi1(ptr, bestpos), "strswitchchar");
+    llvm::IntegerType* charTy = llvm::cast<llvm::IntegerType>(c->getType());
+    llvm::SwitchInst* si = llvm::SwitchInst::Create(c, defbb, groups.size(), p->scopebb());
+
+    std::map<unsigned, StringSwitchCases>::iterator it, end = groups.end();
+    for (it = groups.begin(); it != end; ++it)
+    {
+        llvm::BasicBlock* bb = llvm::BasicBlock::Create(gIR->context(), "strswitchchar", p->topfunc(), oldend);
+        si->addCase(llvm::ConstantInt::get(charTy, it->first), bb);
+        p->scope() = IRScope(bb, oldend);
+        emitStringSwitchTree(p, it->second, ptr, defbb, coldDefault, oldend);
+    }
+    if (coldDefault)
+        DtoSetColdDefault(si);
+}
+
+// lowers a switch on a string to a switch on its length, followed by a
+// decision tree on its characters
+static void emitInlineStringSwitch(IRState* p, CaseStatements* cases, Expression* condition,
+    llvm::BasicBlock* defbb, bool coldDefault, llvm::BasicBlock* oldend)
+{
+    std::map<size_t, StringSwitchCases> bylength;
+    for (unsigned i=0; i<cases->dim; ++i)
+    {
+        CaseStatement* cs = (CaseStatement*)cases->data[i];
+        assert(cs->exp->op == TOKstring);
+        StringExp* str = (StringExp*)cs->exp;
+        bylength[str->len].push_back(StringSwitchCase(str, cs->bodyBB));
+    }
+
+    DValue* cond = condition->toElemDtor(p);
+    LLValue* len = DtoArrayLen(cond);
+    LLValue* ptr = DtoArrayPtr(cond);
+
+    llvm::SwitchInst* si = llvm::SwitchInst::Create(len, defbb, bylength.size(), p->scopebb());
+
+    std::map<size_t, StringSwitchCases>::iterator it, end = bylength.end();
+    for (it = bylength.begin(); it != end; ++it)
+    {
+        llvm::BasicBlock* bb = llvm::BasicBlock::Create(gIR->context(), "strswitchlen", p->topfunc(), oldend);
+        si->addCase(DtoConstSize_t(it->first), bb);
+        p->scope() = IRScope(bb, oldend);
+        emitStringSwitchTree(p, it->second, ptr, defbb, coldDefault, oldend);
+    }
+    if (coldDefault)
+        DtoSetColdDefault(si);
+}
+
 void SwitchStatement::toIR(IRState* p)
 {
     Logger::println("SwitchStatement::toIR(): %s", loc.toChars());
@@ -881,6 +1544,7 @@ void SwitchStatement::toIR(IRState* p)
     // 'switch' instruction (that can happen because D2 allows to
     // initialize a global variable in a static constructor).
     bool useSwitchInst = true;
+    bool constCaseVars = true;
     for (unsigned i=0; i<cases->dim; ++i)
     {
         CaseStatement* cs = (CaseStatement*)cases->data[i];
@@ -888,11 +1552,44 @@ void SwitchStatement::toIR(IRState* p)
         if (cs->exp->op == TOKvar)
             vd = ((VarExp*)cs->exp)->var->isVarDeclaration();
         if (vd && (!vd->init || !vd->isConst())) {
-            cs->llvmIdx = cs->exp->toElemDtor(p)->getRVal();
             useSwitchInst = false;
+            if (!vd->isDataseg() || !(vd->isConst() || vd->isImmutable() ||
+                                      vd->type->isConst() || vd->type->isImmutable()))
+                constCaseVars = false;
         }
     }
 
+    // If there are many cases and all the non-constant ones are const or
+    // immutable globals (which can't change after the static constructors
+    // ran), take a snapshot of the case values the first time the switch is
+    // executed and dispatch using a binary search on it. Otherwise, the case
+    // values are compared one after another.
+    bool useSwitchTable = !useSwitchInst && constCaseVars && cases->dim >= minSwitchTableCases;
+    llvm::BasicBlock* tablebb = NULL;
+    llvm::BasicBlock* tableendbb = NULL;
+    if (useSwitchTable)
+    {
+        tablebb = llvm::BasicBlock::Create(gIR->context(), "switchtable", p->topfunc(), oldend);
+        p->scope() = IRScope(tablebb, oldend);
+    }
+    if (!useSwitchInst)
+    {
+        for (unsigned i=0; i<cases->dim; ++i)
+        {
+            CaseStatement* cs = (CaseStatement*)cases->data[i];
+            VarDeclaration* vd = 0;
+            if (cs->exp->op == TOKvar)
+                vd = ((VarExp*)cs->exp)->var->isVarDeclaration();
+            if (useSwitchTable || (vd && (!vd->init || !vd->isConst())))
+                cs->llvmIdx = cs->exp->toElemDtor(p)->getRVal();
+        }
+    }
+    if (useSwitchTable)
+    {
+        tableendbb = p->scopebb();
+        p->scope() = IRScope(oldbb, oldend);
+    }
+
     // body block.
     // FIXME: that block is never used
     llvm::BasicBlock* bodybb = llvm::BasicBlock::Create(gIR->context(), "switchbody", p->topfunc(), oldend);
@@ -918,7 +1615,12 @@ void SwitchStatement::toIR(IRState* p)
         llvm::BranchInst::Create(endbb, p->scopebb());
 
     gIR->scope() = IRScope(oldbb,oldend);
-    if (useSwitchInst)
+    if (useSwitchInst && !condition->type->isintegral() && cases->dim <= maxInlineStringSwitchCases)
+    {
+        Logger::println("is inline string switch");
+        emitInlineStringSwitch(p, cases, condition, defbb ? defbb : endbb, hasNoDefault, oldend);
+    }
+    else if (useSwitchInst)
     {
         // string switch?
         llvm::Value* switchTable = 0;
@@ -985,6 +1687,15 @@ void SwitchStatement::toIR(IRState* p)
             CaseStatement* cs = (CaseStatement*)cases->data[i];
             si->addCase(isaConstantInt(cs->llvmIdx), cs->bodyBB);
         }
+        // the implicit default only raises a switch error or halts
+        if (hasNoDefault)
+            DtoSetColdDefault(si);
+    }
+    else if (useSwitchTable)
+    {
+        LLValue* condVal = condition->toElemDtor(p)->getRVal();
+        emitSwitchTableLookup(p, cases, condVal, condition->type->isunsigned() == 0,
+            tablebb, tableendbb, defbb ? defbb : endbb, hasNoDefault, oldend);
     }
     else
     { // we can't use switch, so we will use a bunch of br instructions instead
@@ -1611,6 +2322,11 @@ void SwitchErrorStatement::toIR(IRState* p)
     Logger::println("SwitchErrorStatement::toIR(): %s", loc.toChars());
     LOG_SCOPE;
 
+    // move the error path out of the way of the cases
+    llvm::BasicBlock* errorbb = DtoCreateColdBlock("switcherror");
+    llvm::BranchInst::Create(errorbb, p->scopebb());
+    p->scope() = IRScope(errorbb, p->scopeend());
+
     llvm::Function* fn = LLVM_D_GetRuntimeFunction(gIR->module, "_d_switch_error");
 
     std::vector<LLValue*> args;
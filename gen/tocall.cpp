@@ -245,38 +245,48 @@ void DtoBuildDVarArgList(std::vector<LLValue*>& args,
         DtoVariadicArgument(argexp, argdst);
     }
 
-    // build type info array
+    // build type info array, shared by all calls with the same argument types
     LLType* typeinfotype = DtoType(Type::typeinfo->type);
     LLArrayType* typeinfoarraytype = LLArrayType::get(typeinfotype,vtype->getNumElements());
 
-    llvm::GlobalVariable* typeinfomem =
-        new llvm::GlobalVariable(*gIR->module, typeinfoarraytype, true, llvm::GlobalValue::InternalLinkage, NULL, "._arguments.storage");
-    if (Logger::enabled())
-        Logger::cout() << "_arguments storage: " << *typeinfomem << '\n';
-
-    std::vector<LLConstant*> vtypeinfos;
-    for (int i=begin,k=0; i<n_arguments; i++,k++)
+    std::string tiname = "._arguments.storage";
+    for (int i=begin; i<n_arguments && !tiname.empty(); i++)
     {
         Expression* argexp = (Expression*)arguments->data[i];
-        vtypeinfos.push_back(DtoTypeInfoOf(argexp->type));
+        if (argexp->type->deco)
+            tiname.append(".").append(argexp->type->deco);
+        else
+            tiname.clear();
     }
 
-    // apply initializer
-    LLConstant* tiinits = LLConstantArray::get(typeinfoarraytype, vtypeinfos);
-    typeinfomem->setInitializer(tiinits);
+    llvm::GlobalVariable* typeinfomem = tiname.empty() ? NULL : gIR->module->getGlobalVariable(tiname, true);
+    if (!typeinfomem || typeinfomem->getType()->getElementType() != typeinfoarraytype)
+    {
+        std::vector<LLConstant*> vtypeinfos;
+        for (int i=begin,k=0; i<n_arguments; i++,k++)
+        {
+            Expression* argexp = (Expression*)arguments->data[i];
+            vtypeinfos.push_back(DtoTypeInfoOf(argexp->type));
+        }
+
+        LLConstant* tiinits = LLConstantArray::get(typeinfoarraytype, vtypeinfos);
+        typeinfomem = new llvm::GlobalVariable(*gIR->module, typeinfoarraytype, true,
+            llvm::GlobalValue::InternalLinkage, tiinits, tiname.empty() ? "._arguments.storage" : tiname);
+        typeinfomem->setUnnamedAddr(true);
+    }
+    if (Logger::enabled())
+        Logger::cout() << "_arguments storage: " << *typeinfomem << '\n';
 
-    // put data in d-array
+    // pass the d-array by value, so the callee can see its length if inlined
     std::vector<LLConstant*> pinits;
     pinits.push_back(DtoConstSize_t(vtype->getNumElements()));
     pinits.push_back(llvm::ConstantExpr::getBitCast(typeinfomem, getPtrToType(typeinfotype)));
     LLType* tiarrty = DtoType(Type::typeinfo->type->arrayOf());
-    tiinits = LLConstantStruct::get(isaStruct(tiarrty), pinits);
-    LLValue* typeinfoarrayparam = new llvm::GlobalVariable(*gIR->module, tiarrty,
-        true, llvm::GlobalValue::InternalLinkage, tiinits, "._arguments.array");
+    LLConstant* typeinfoarrayparam = LLConstantStruct::get(isaStruct(tiarrty), pinits);
 
     llvm::AttributeWithIndex Attr;
     // specify arguments
-    args.push_back(DtoLoad(typeinfoarrayparam));
+    args.push_back(typeinfoarrayparam);
     if (unsigned atts = tf->fty.arg_arguments->attrs) {
         Attr.Index = argidx;
         Attr.Attrs = atts;
@@ -2106,14 +2106,14 @@ DValue* AssertExp::toElem(IRState* p)
 
     // create basic blocks
     llvm::BasicBlock* oldend = p->scopeend();
-    llvm::BasicBlock* assertbb = llvm::BasicBlock::Create(gIR->context(), "assert", p->topfunc(), oldend);
+    llvm::BasicBlock* assertbb = DtoCreateColdBlock("assert");
     llvm::BasicBlock* endbb = llvm::BasicBlock::Create(gIR->context(), "noassert", p->topfunc(), oldend);
 
     // test condition
     LLValue* condval = DtoCast(loc, cond, Type::tbool)->getRVal();
 
     // branch
-    llvm::BranchInst::Create(endbb, assertbb, condval, p->scopebb());
+    DtoCondBrCold(condval, endbb, assertbb);
 
     // call assert runtime functions
     p->scope() = IRScope(assertbb,endbb);
@@ -2698,6 +2698,65 @@ LLConstant* FuncExp::toConstElem(IRState* p)
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+// Returns true if e has a constant value that doesn't refer to memory a
+// fresh evaluation of e would allocate, so that it can be shared.
+static bool isConstLiteral(Expression* e)
+{
+    switch (e->op)
+    {
+    case TOKint64:
+    case TOKfloat64:
+    case TOKcomplex80:
+    case TOKnull:
+    case TOKstring:
+        return true;
+
+    case TOKarrayliteral: {
+        // the storage of a dynamic array literal is not shared
+        if (e->type->toBasetype()->ty != Tsarray)
+            return false;
+        ArrayLiteralExp* ale = static_cast<ArrayLiteralExp*>(e);
+        for (size_t i = 0; i < ale->elements->dim; i++)
+            if (!isConstLiteral((Expression*)ale->elements->data[i]))
+                return false;
+        return true;
+    }
+
+    case TOKstructliteral: {
+        StructLiteralExp* sle = static_cast<StructLiteralExp*>(e);
+        // the context pointer of a nested struct is not constant
+        if (sle->sd->isNested())
+            return false;
+        for (size_t i = 0; i < sle->elements->dim; i++)
+        {
+            Expression* elem = (Expression*)sle->elements->data[i];
+            if (elem && !isConstLiteral(elem))
+                return false;
+        }
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+// Builds the constant array holding the elements of an array literal.
+static LLConstant* arrayLiteralToConstArray(IRState* p, ArrayLiteralExp* e, LLType* llElemType)
+{
+    std::vector<LLConstant*> vals(e->elements->dim, NULL);
+    for (unsigned i = 0; i < e->elements->dim; ++i)
+    {
+        Expression* expr = (Expression*)e->elements->data[i];
+        vals[i] = expr->toConstElem(p);
+    }
+
+    // the type of the constants may differ from that of the elements
+    LLArrayType *t = LLArrayType::get(vals.empty() ? llElemType : vals.front()->getType(),
+                                      e->elements->dim);
+    return LLConstantArray::get(t, vals);
+}
+
 DValue* ArrayLiteralExp::toElem(IRState* p)
 {
     Logger::print("ArrayLiteralExp::toElem: %s @ %s\n", toChars(), type->toChars());
@@ -2730,6 +2789,30 @@ DValue* ArrayLiteralExp::toElem(IRState* p)
         return new DSliceValue(type, DtoConstSize_t(0), getNullPtr(getPtrToType(llElemType)));
     }
 
+    // If all elements are constant, copy them from a constant global
+    // instead of storing them one by one.
+    LLConstant* constMem = NULL;
+    bool allConst = true;
+    for (size_t i = 0; i < len && allConst; ++i)
+        allConst = isConstLiteral((Expression*)elements->data[i]);
+    if (allConst)
+    {
+        LLConstant* init = arrayLiteralToConstArray(p, this, llElemType);
+        if (getTypeAllocSize(init->getType()) == getTypeAllocSize(llStoType))
+        {
+            llvm::GlobalVariable* gvar = new llvm::GlobalVariable(*gIR->module, init->getType(), true,
+                llvm::GlobalValue::InternalLinkage, init, ".arrayliteral");
+            gvar->setUnnamedAddr(true);
+            constMem = DtoBitCast(gvar, getPtrToType(llElemType));
+        }
+    }
+
+#if DMDV2
+    // immutable elements need no copy
+    if (dyn && constMem && arrayType->nextOf()->isImmutable())
+        return new DSliceValue(type, DtoConstSize_t(len), constMem);
+#endif
+
     // dst pointer
     LLValue* dstMem;
     DSliceValue* dynSlice = NULL;
@@ -2741,20 +2824,29 @@ DValue* ArrayLiteralExp::toElem(IRState* p)
     else
         dstMem = DtoRawAlloca(llStoType, 0, "arrayliteral");
 
+    // copy constant elements
+    if (constMem)
+    {
+        DtoMemCpy(dstMem, constMem, DtoConstSize_t(getTypeAllocSize(llStoType)),
+                  getABITypeAlign(llElemType));
+    }
     // store elements
-    for (size_t i=0; i<len; ++i)
+    else
     {
-        Expression* expr = (Expression*)elements->data[i];
-        LLValue* elemAddr;
-        if(dyn)
-            elemAddr = DtoGEPi1(dstMem, i, "tmp", p->scopebb());
-        else
-            elemAddr = DtoGEPi(dstMem,0,i,"tmp",p->scopebb());
+        for (size_t i=0; i<len; ++i)
+        {
+            Expression* expr = (Expression*)elements->data[i];
+            LLValue* elemAddr;
+            if(dyn)
+                elemAddr = DtoGEPi1(dstMem, i, "tmp", p->scopebb());
+            else
+                elemAddr = DtoGEPi(dstMem,0,i,"tmp",p->scopebb());
 
-        // emulate assignment
-        DVarValue* vv = new DVarValue(expr->type, elemAddr);
-        DValue* e = expr->toElem(p);
-        DtoAssign(loc, vv, e);
+            // emulate assignment
+            DVarValue* vv = new DVarValue(expr->type, elemAddr);
+            DValue* e = expr->toElem(p);
+            DtoAssign(loc, vv, e);
+        }
     }
 
     // return storage directly ?
@@ -2782,19 +2874,9 @@ LLConstant* ArrayLiteralExp::toConstElem(IRState* p)
     // dynamic arrays can occur here as well ...
     bool dyn = (bt->ty != Tsarray);
 
-    // build the initializer
-    std::vector<LLConstant*> vals(elements->dim, NULL);
-    for (unsigned i=0; i<elements->dim; ++i)
-    {
-        Expression* expr = (Expression*)elements->data[i];
-        vals[i] = expr->toConstElem(p);
-    }
-
     // build the constant array initialize
-    LLArrayType *t = elements->dim == 0 ?
-                           arrtype :
-                           LLArrayType::get(vals.front()->getType(), elements->dim);
-    LLConstant* initval = LLConstantArray::get(t, vals);
+    LLConstant* initval = arrayLiteralToConstArray(p, this, arrtype->getElementType());
+    LLType* t = initval->getType();
 
     // if static array, we're done
     if (!dyn)
@@ -3019,6 +3101,10 @@ DValue* AssocArrayLiteralExp::toElem(IRState* p)
         valuesInits.push_back(evalConst);
     }
 
+    // build the hash table at compile time if the keys can be hashed
+    if (LLValue* aa = DtoConstAALiteral(aatype, keys, keysInits, valuesInits))
+        return new DImValue(type, aa);
+
     {
         Type* indexType = ((TypeAArray*)aatype)->index;
 
@@ -3030,20 +3116,44 @@ DValue* AssocArrayLiteralExp::toElem(IRState* p)
 
         LLArrayType* arrtype = LLArrayType::get(DtoType(indexType), keys->dim);
         LLConstant* initval = LLConstantArray::get(arrtype, keysInits);
-        LLConstant* globalstore = new LLGlobalVariable(*gIR->module, arrtype, false, LLGlobalValue::InternalLinkage, initval, ".aaKeysStorage");
+        // the runtime copies the keys and values into the new hash table
+        LLGlobalVariable* globalstore = new LLGlobalVariable(*gIR->module, arrtype, true, LLGlobalValue::InternalLinkage, initval, ".aaKeysStorage");
+        globalstore->setUnnamedAddr(true);
         LLConstant* slice = llvm::ConstantExpr::getGetElementPtr(globalstore, idxs, true);
         slice = DtoConstSlice(DtoConstSize_t(keys->dim), slice);
         LLValue* keysArray = DtoAggrPaint(slice, funcTy->getParamType(1));
 
         arrtype = LLArrayType::get(DtoType(vtype), values->dim);
         initval = LLConstantArray::get(arrtype, valuesInits);
-        globalstore = new LLGlobalVariable(*gIR->module, arrtype, false, LLGlobalValue::InternalLinkage, initval, ".aaValuesStorage");
+        globalstore = new LLGlobalVariable(*gIR->module, arrtype, true, LLGlobalValue::InternalLinkage, initval, ".aaValuesStorage");
+        globalstore->setUnnamedAddr(true);
         slice = llvm::ConstantExpr::getGetElementPtr(globalstore, idxs, true);
         slice = DtoConstSlice(DtoConstSize_t(keys->dim), slice);
         LLValue* valuesArray = DtoAggrPaint(slice, funcTy->getParamType(2));
 
+        if (!aatype->isImmutable())
+        {
+            LLValue* aa = gIR->CreateCallOrInvoke3(func, aaTypeInfo, keysArray, valuesArray, "aa").getInstruction();
+            return new DImValue(type, aa);
+        }
+
+        // an immutable literal can't be changed, so it only needs to be
+        // built on the first evaluation in each thread
+        LLGlobalVariable* cache = new LLGlobalVariable(*gIR->module, getVoidPtrType(), false,
+            LLGlobalValue::InternalLinkage, getNullPtr(getVoidPtrType()), ".aaliteral", 0, true);
+
+        llvm::BasicBlock* oldend = gIR->scopeend();
+        llvm::BasicBlock* buildbb = llvm::BasicBlock::Create(gIR->context(), "aaliteral.build", gIR->topfunc(), oldend);
+        llvm::BasicBlock* endbb = llvm::BasicBlock::Create(gIR->context(), "aaliteral.end", gIR->topfunc(), oldend);
+        gIR->ir->CreateCondBr(gIR->ir->CreateIsNull(DtoLoad(cache)), buildbb, endbb);
+
+        gIR->scope() = IRScope(buildbb, endbb);
         LLValue* aa = gIR->CreateCallOrInvoke3(func, aaTypeInfo, keysArray, valuesArray, "aa").getInstruction();
-        return new DImValue(type, aa);
+        DtoStore(aa, cache);
+        gIR->ir->CreateBr(endbb);
+
+        gIR->scope() = IRScope(endbb, oldend);
+        return new DImValue(type, DtoLoad(cache));
     }
 
 LruntimeInit:
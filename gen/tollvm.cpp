@@ -274,6 +274,9 @@ LLGlobalValue::LinkageTypes DtoLinkage(Dsymbol* sym)
         // generated by inlining semantics run
         if (fdecl->availableExternally && mustDefineSymbol(sym))
             return llvm::GlobalValue::AvailableExternallyLinkage;
+        // copy of a template instance defined in another module
+        if (isInlineableTemplateCopy(fdecl))
+            return llvm::GlobalValue::AvailableExternallyLinkage;
         // array operations are always template linkage
         if (fdecl->isArrayOp == 1)
             return templateLinkage;
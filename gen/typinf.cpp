@@ -326,7 +326,6 @@ void DtoResolveTypeInfo(TypeInfoDeclaration* tid)
 
     tid->ir.irGlobal = irg;
 
-#if USE_METADATA
     // don't do this for void or llvm will crash
     if (tid->tinfo->ty != Tvoid) {
         // Add some metadata for use by optimization passes.
@@ -340,13 +339,12 @@ void DtoResolveTypeInfo(TypeInfoDeclaration* tid)
             if (TD_Confirm >= 0)
                 mdVals[TD_Confirm] = llvm::cast<MDNodeField>(irg->value);
             mdVals[TD_Type] = llvm::UndefValue::get(DtoType(tid->tinfo));
-            // Construct the metadata
-            llvm::MetadataBase* metadata = llvm::MDNode::get(gIR->context(), mdVals, TD_NumFields);
-            // Insert it into the module
-            llvm::NamedMDNode::Create(gIR->context(), metaname, &metadata, 1, gIR->module);
+            // Construct the metadata and insert it into the module.
+            llvm::MDNode* metadata = llvm::MDNode::get(gIR->context(),
+                llvm::makeArrayRef(mdVals, TD_NumFields));
+            gIR->module->getOrInsertNamedMetadata(metaname)->addOperand(metadata);
         }
     }
-#endif // USE_METADATA
 
     DtoDeclareTypeInfo(tid);
 }
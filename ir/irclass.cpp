@@ -73,7 +73,6 @@ LLGlobalVariable * IrStruct::getClassInfoSymbol()
     classInfo = new llvm::GlobalVariable(
                 *gIR->module, tc->getType(), false, _linkage, NULL, initname);
 
-#if USE_METADATA
     // Generate some metadata on this ClassInfo if it's for a class.
     ClassDeclaration* classdecl = aggrdecl->isClassDeclaration();
     if (classdecl && !aggrdecl->isInterfaceDeclaration()) {
@@ -87,13 +86,12 @@ LLGlobalVariable * IrStruct::getClassInfoSymbol()
         mdVals[CD_BodyType] = llvm::UndefValue::get(bodyType);
         mdVals[CD_Finalize] = LLConstantInt::get(LLType::getInt1Ty(gIR->context()), hasDestructor);
         mdVals[CD_CustomDelete] = LLConstantInt::get(LLType::getInt1Ty(gIR->context()), hasCustomDelete);
-        // Construct the metadata
-        llvm::MetadataBase* metadata = llvm::MDNode::get(gIR->context(), mdVals, CD_NumFields);
-        // Insert it into the module
+        // Construct the metadata and insert it into the module.
+        llvm::MDNode* metadata = llvm::MDNode::get(gIR->context(),
+            llvm::makeArrayRef(mdVals, CD_NumFields));
         std::string metaname = CD_PREFIX + initname;
-        llvm::NamedMDNode::Create(gIR->context(), metaname, &metadata, 1, gIR->module);
+        gIR->module->getOrInsertNamedMetadata(metaname)->addOperand(metadata);
     }
-#endif // USE_METADATA
 
     return classInfo;
 }